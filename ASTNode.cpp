@@ -3,6 +3,9 @@
 //
 
 #include "ASTNode.h"
+#include "Stats.h"
+#include "Types.h"
+#include <limits>
 #include <unordered_map>
 
 using namespace AST;
@@ -41,22 +44,83 @@ void AST::BinaryOpNode::transpile(std::ostream &out) {
 }
 
 void AST::IntegerLiteralNode::transpile(std::ostream &out) {
-    out << "(" << value << ")";
+    out << "(" << value;
+    // Too large for any signed C++ literal type
+    if(value > static_cast<IntegerLiteral>(std::numeric_limits<long long>::max()))
+        out << "ull";
+    out << ")";
 }
 
 void AST::IdentifierNode::transpile(std::ostream &out) {
     out << "(" << identifier << ")";
 }
 
-void AST::FunctionNode::transpile(std::ostream &out) {
-    out << "int " << name << '(';
-    for(std::size_t i = 1; const auto &parameter : parameters) {
-        out << "int " << parameter;
-        if(i != parameters.size())
+// The language has no exceptions, so every function is noexcept
+static void transpile_signature(std::ostream &out, const FunctionNode &function, const Identifier &name,
+                                bool internal) {
+    switch(function.temperature) {
+        case Temperature::Hot:
+            out << "[[gnu::hot]] ";
+            break;
+        case Temperature::Cold:
+            out << "[[gnu::cold]] ";
+            break;
+        case Temperature::Normal:
+            break;
+    }
+    switch(function.effect) {
+        case Effect::Const:
+            out << "[[gnu::const]] ";
+            break;
+        case Effect::Pure:
+            out << "[[gnu::pure]] ";
+            break;
+        case Effect::Impure:
+            break;
+    }
+    if(internal)
+        out << "static ";
+    out << Types::cpp_name(function.return_type) << ' ' << name << '(';
+    for(std::size_t i = 0; i < function.parameters.size(); ++i) {
+        out << Types::cpp_name(function.parameter_types[i]) << ' ' << function.parameters[i];
+        if(i + 1 != function.parameters.size())
             out << ", ";
-        ++i;
     }
-    out << ") {\n";
+    out << ") noexcept";
+}
+
+void AST::FunctionNode::transpile(std::ostream &out) {
+    STATS_PHASE(Transpile);
+    STATS_COUNT(FunctionsWritten);
+    STATS_WRITTEN(out);
+    if(memoize) {
+        // The public function looks the arguments up in a cache and only calls the body on a miss.
+        // Recursive calls inside the body go through the public function, so they hit the cache as well.
+        const auto body_name = name + "_body";
+        transpile_signature(out, *this, body_name, true);
+        out << ";\n";
+        transpile_signature(out, *this, name, internal);
+        out << " {\nstatic arj::memo_cache<4096, " << Types::cpp_name(return_type);
+        for(auto type : parameter_types)
+            out << ", " << Types::cpp_name(type);
+        out << "> cache;\nreturn cache.lookup([&] { return " << body_name << '(';
+        for(std::size_t i = 1; const auto &parameter : parameters) {
+            out << parameter;
+            if(i != parameters.size())
+                out << ", ";
+            ++i;
+        }
+        out << "); }";
+        for(const auto &parameter : parameters)
+            out << ", " << parameter;
+        out << ");\n}\n";
+        transpile_signature(out, *this, body_name, true);
+    } else {
+        transpile_signature(out, *this, name, internal);
+    }
+    out << " {\n";
+    if(profile_slot)
+        out << "++arj::profile::calls[" << *profile_slot << "];\n";
     for(const auto &statement : statements) {
         statement->transpile(out);
         out << ";\n";
@@ -64,20 +128,61 @@ void AST::FunctionNode::transpile(std::ostream &out) {
     out << "}\n";
 }
 
+static const char *likelihood_attribute(Likelihood likelihood) {
+    switch(likelihood) {
+        case Likelihood::Likely:
+            return " [[likely]]";
+        case Likelihood::Unlikely:
+            return " [[unlikely]]";
+        case Likelihood::Unknown:
+            break;
+    }
+    return "";
+}
+
 void AST::IfNode::transpile(std::ostream &out) {
     out << "if (";
+    // Counts the outcome and passes it on
+    if(profile_slot)
+        out << "arj::profile::branch(" << *profile_slot << ", static_cast<bool>";
     expression->transpile(out);
-    out << ") ";
+    if(profile_slot)
+        out << ')';
+    out << ')' << likelihood_attribute(likelihood) << " {\n";
     statement->transpile(out);
+    out << ";\n}";
     if(elseStatement) {
-        out << ";\nelse (";
+        // The else branch is as likely as the then branch is unlikely
+        const auto otherwise = likelihood == Likelihood::Likely ? Likelihood::Unlikely
+                               : likelihood == Likelihood::Unlikely ? Likelihood::Likely : Likelihood::Unknown;
+        out << "\nelse" << likelihood_attribute(otherwise) << " {\n";
         elseStatement->transpile(out);
+        out << ";\n}";
+    }
+}
+
+void ConditionalNode::transpile(std::ostream &out) {
+    if(branchless) {
+        out << "arj::select<" << Types::cpp_name(type) << ">(static_cast<bool>";
+        condition->transpile(out);
+        out << ", ";
+        then->transpile(out);
+        out << ", ";
+        otherwise->transpile(out);
         out << ")";
+        return;
     }
+    out << "((";
+    condition->transpile(out);
+    out << ") ? (";
+    then->transpile(out);
+    out << ") : (";
+    otherwise->transpile(out);
+    out << "))";
 }
 
 void DeclarationNode::transpile(std::ostream &out) {
-    out << "int " << name << " = (";
+    out << Types::cpp_name(type) << ' ' << name << " = (";
     expression->transpile(out);
     out << ")";
 }
@@ -98,3 +203,249 @@ void FunctionCall::transpile(std::ostream &out) {
     }
     out << ")";
 }
+
+std::size_t AST::size(Node &node) {
+    std::size_t total = 1;
+    for(auto *child : node.children()) {
+        if(*child)
+            total += size(**child);
+    }
+    return total;
+}
+
+bool AST::contains_array(Node &node) {
+    bool found = false;
+    for_each(node, [&](Node &child) {
+        found = found || dynamic_cast<ArrayDeclarationNode *>(&child);
+    });
+    return found;
+}
+
+bool AST::contains_select(Node &node) {
+    bool found = false;
+    for_each(node, [&](Node &child) {
+        auto *conditional = dynamic_cast<ConditionalNode *>(&child);
+        found = found || (conditional && conditional->branchless);
+    });
+    return found;
+}
+
+NodePtr IntegerLiteralNode::clone() const {
+    return std::make_unique<IntegerLiteralNode>(value);
+}
+
+NodePtr IdentifierNode::clone() const {
+    return std::make_unique<IdentifierNode>(identifier);
+}
+
+NodePtr BinaryOpNode::clone() const {
+    return std::make_unique<BinaryOpNode>(op, left->clone(), right->clone());
+}
+
+std::vector<NodePtr *> BinaryOpNode::children() {
+    return {&left, &right};
+}
+
+NodePtr FunctionNode::clone() const {
+    std::vector<NodePtr> copies;
+    copies.reserve(statements.size());
+    for(const auto &statement : statements)
+        copies.emplace_back(statement->clone());
+    auto copy = std::make_unique<FunctionNode>(name, parameters, std::move(copies));
+    copy->parameter_types = parameter_types;
+    copy->return_type = return_type;
+    copy->memoize = memoize;
+    copy->effect = effect;
+    copy->internal = internal;
+    copy->temperature = temperature;
+    copy->profile_slot = profile_slot;
+    return copy;
+}
+
+std::vector<NodePtr *> FunctionNode::children() {
+    std::vector<NodePtr *> ret;
+    ret.reserve(statements.size());
+    for(auto &statement : statements)
+        ret.push_back(&statement);
+    return ret;
+}
+
+NodePtr IfNode::clone() const {
+    auto copy = std::make_unique<IfNode>(expression->clone(), statement->clone(),
+                                         elseStatement ? elseStatement->clone() : nullptr);
+    copy->profile_index = profile_index;
+    copy->profile_slot = profile_slot;
+    copy->likelihood = likelihood;
+    return copy;
+}
+
+std::vector<NodePtr *> IfNode::children() {
+    if(elseStatement)
+        return {&expression, &statement, &elseStatement};
+    return {&expression, &statement};
+}
+
+NodePtr ConditionalNode::clone() const {
+    auto copy = std::make_unique<ConditionalNode>(condition->clone(), then->clone(), otherwise->clone());
+    copy->branchless = branchless;
+    copy->type = type;
+    return copy;
+}
+
+std::vector<NodePtr *> ConditionalNode::children() {
+    return {&condition, &then, &otherwise};
+}
+
+NodePtr DeclarationNode::clone() const {
+    return std::make_unique<DeclarationNode>(name, expression->clone(), type);
+}
+
+std::vector<NodePtr *> DeclarationNode::children() {
+    return {&expression};
+}
+
+NodePtr ReturnNode::clone() const {
+    return std::make_unique<ReturnNode>(expression->clone());
+}
+
+std::vector<NodePtr *> ReturnNode::children() {
+    return {&expression};
+}
+
+NodePtr FunctionCall::clone() const {
+    std::vector<NodePtr> copies;
+    copies.reserve(arguments.size());
+    for(const auto &argument : arguments)
+        copies.emplace_back(argument->clone());
+    return std::make_unique<FunctionCall>(identifier, std::move(copies));
+}
+
+std::vector<NodePtr *> FunctionCall::children() {
+    std::vector<NodePtr *> ret;
+    ret.reserve(arguments.size());
+    for(auto &argument : arguments)
+        ret.push_back(&argument);
+    return ret;
+}
+
+void BlockNode::transpile(std::ostream &out) {
+    out << "{\n";
+    for(const auto &statement : statements) {
+        statement->transpile(out);
+        out << ";\n";
+    }
+    out << "}";
+}
+
+NodePtr BlockNode::clone() const {
+    std::vector<NodePtr> copies;
+    copies.reserve(statements.size());
+    for(const auto &statement : statements)
+        copies.emplace_back(statement->clone());
+    return std::make_unique<BlockNode>(std::move(copies));
+}
+
+std::vector<NodePtr *> BlockNode::children() {
+    std::vector<NodePtr *> ret;
+    ret.reserve(statements.size());
+    for(auto &statement : statements)
+        ret.push_back(&statement);
+    return ret;
+}
+
+void WhileNode::transpile(std::ostream &out) {
+    // A directive has to start its own line
+    if(vectorize)
+        out << "\n#pragma GCC ivdep\n";
+    out << "while (";
+    if(condition)
+        condition->transpile(out);
+    else
+        out << "true";
+    out << ") ";
+    body->transpile(out);
+}
+
+NodePtr WhileNode::clone() const {
+    auto copy = std::make_unique<WhileNode>(condition ? condition->clone() : nullptr, body->clone());
+    copy->vectorize = vectorize;
+    return copy;
+}
+
+std::vector<NodePtr *> WhileNode::children() {
+    if(condition)
+        return {&condition, &body};
+    return {&body};
+}
+
+void AssignmentNode::transpile(std::ostream &out) {
+    if(element)
+        element->transpile(out);
+    else
+        out << name;
+    out << " = (";
+    expression->transpile(out);
+    out << ")";
+}
+
+NodePtr AssignmentNode::clone() const {
+    return std::make_unique<AssignmentNode>(name, expression->clone(), element ? element->clone() : nullptr);
+}
+
+std::vector<NodePtr *> AssignmentNode::children() {
+    if(element)
+        return {&element, &expression};
+    return {&expression};
+}
+
+// Larger arrays go on the heap, so they can't overflow the stack
+static constexpr IntegerLiteral max_stack_array_bytes = 64 * 1024;
+
+void ArrayDeclarationNode::transpile(std::ostream &out) {
+    auto *literal = dynamic_cast<IntegerLiteralNode *>(size.get());
+    if(literal && literal->value <= max_stack_array_bytes / Types::size(element_type)) {
+        out << "std::array<" << Types::cpp_name(element_type) << ", " << literal->value << "> " << name << "{}";
+        return;
+    }
+    out << "std::vector<" << Types::cpp_name(element_type) << "> " << name << "(static_cast<std::size_t>(";
+    size->transpile(out);
+    out << "))";
+}
+
+NodePtr ArrayDeclarationNode::clone() const {
+    return std::make_unique<ArrayDeclarationNode>(name, element_type, size->clone());
+}
+
+std::vector<NodePtr *> ArrayDeclarationNode::children() {
+    return {&size};
+}
+
+void IndexNode::transpile(std::ostream &out) {
+    if(checked) {
+        out << "arj::at(" << array << ", ";
+        index->transpile(out);
+        out << ")";
+        return;
+    }
+    out << array << "[static_cast<std::size_t>(";
+    index->transpile(out);
+    out << ")]";
+}
+
+NodePtr IndexNode::clone() const {
+    auto copy = std::make_unique<IndexNode>(array, index->clone());
+    copy->checked = checked;
+    return copy;
+}
+
+std::vector<NodePtr *> IndexNode::children() {
+    return {&index};
+}
+
+void ContinueNode::transpile(std::ostream &out) {
+    out << "continue";
+}
+
+NodePtr ContinueNode::clone() const {
+    return std::make_unique<ContinueNode>();
+}
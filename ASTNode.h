@@ -9,9 +9,45 @@
 #include <utility>
 #include <vector>
 #include <optional>
+#include <cstdint>
 #include "Token.h"
 #include <ostream>
 
+// Ordered from most to least optimizable, the effect of a function is the maximum over its body
+enum class Effect {
+    Const,  // Result depends only on the arguments, emitted as [[gnu::const]]
+    Pure,   // Also reads memory that can't be observed from the program, like a memo cache, [[gnu::pure]]
+    Impure, // Prints, may abort on an array access, or calls something that does
+};
+
+// How often a function ran in a profile, emitted as [[gnu::hot]] and [[gnu::cold]]
+enum class Temperature {
+    Normal,
+    Hot,  // Among the functions that made most of the calls
+    Cold, // Never called
+};
+
+// How often the then branch of an if was taken in a profile, emitted as [[likely]] and [[unlikely]]
+enum class Likelihood {
+    Unknown,
+    Likely,
+    Unlikely,
+};
+
+// Width and signedness of a value. Int is what everything without a type annotation gets, emitted as a plain int.
+enum class IntegerType : std::uint8_t {
+    Int,
+    I8, I16, I32, I64,
+    U8, U16, U32, U64,
+};
+
+struct Signature {
+    IntegerType result = IntegerType::Int;
+    std::vector<IntegerType> parameters;
+
+    bool operator==(const Signature &) const = default;
+};
+
 namespace AST {
     struct Node;
 
@@ -20,14 +56,41 @@ namespace AST {
     struct Node {
         virtual ~Node() = default;
         virtual void transpile(std::ostream &) = 0;
+
+        // Deep copy of the subtree rooted at this node
+        [[nodiscard]] virtual NodePtr clone() const = 0;
+
+        // Owning slots of the direct children, so passes can walk and rewrite the tree in place
+        virtual std::vector<NodePtr *> children() { return {}; }
     };
 
+    // Number of nodes in the subtree, used as the size metric by the optimization passes
+    std::size_t size(Node &);
+
+    // True if any conditional in the subtree is lowered to arj::select
+    bool contains_select(Node &);
+
+    // True if the subtree declares an array, which needs the array runtime support
+    bool contains_array(Node &);
+
+    // Pre-order walk over every node in the subtree
+    template<typename F>
+    void for_each(Node &node, F &&visit) {
+        visit(node);
+        for(auto *child : node.children()) {
+            if(*child)
+                for_each(**child, visit);
+        }
+    }
+
     struct IntegerLiteralNode : public Node {
         IntegerLiteral value;
 
         explicit IntegerLiteralNode(IntegerLiteral value) : value(value) {}
 
         void transpile(std::ostream &out) override;
+
+        [[nodiscard]] NodePtr clone() const override;
     };
 
     using IntegerLiteralNodePtr = std::unique_ptr<IntegerLiteralNode>;
@@ -38,6 +101,8 @@ namespace AST {
         explicit IdentifierNode(Identifier identifier) : identifier(std::move(identifier)) {}
 
         void transpile(std::ostream &out) override;
+
+        [[nodiscard]] NodePtr clone() const override;
     };
 
     using IdentifierNodePtr = std::unique_ptr<IdentifierNode>;
@@ -53,6 +118,10 @@ namespace AST {
 
         void transpile(std::ostream &out) override;
 
+        [[nodiscard]] NodePtr clone() const override;
+
+        std::vector<NodePtr *> children() override;
+
     };
 
     using BinaryOpNodePtr = std::unique_ptr<BinaryOpNode>;
@@ -61,11 +130,31 @@ namespace AST {
         Identifier name;
         std::vector<Identifier> parameters;
         std::vector<NodePtr> statements;
+        // One per parameter
+        std::vector<IntegerType> parameter_types;
+        IntegerType return_type = IntegerType::Int;
+        // Calls are cached, either requested with the memo keyword or chosen by the Memoizer
+        bool memoize = false;
+        // Filled in by EffectAnalysis::annotate
+        Effect effect = Effect::Impure;
+        // Only called from within the generated file, emitted as static
+        bool internal = false;
+        // Set by Profile::apply
+        Temperature temperature = Temperature::Normal;
+        // The call counter of an instrumented program, set by Profile::instrument
+        std::optional<std::size_t> profile_slot;
 
         FunctionNode(Identifier name, std::vector<Identifier> parameters, std::vector<NodePtr> statements) :
-        name(std::move(name)), parameters(std::move(parameters)), statements(std::move(statements)) {}
+        name(std::move(name)), parameters(std::move(parameters)), statements(std::move(statements)),
+        parameter_types(this->parameters.size(), IntegerType::Int) {}
+
+        [[nodiscard]] Signature signature() const { return {return_type, parameter_types}; }
 
         void transpile(std::ostream &out) override;
+
+        [[nodiscard]] NodePtr clone() const override;
+
+        std::vector<NodePtr *> children() override;
     };
 
     using FunctionNodePtr = std::unique_ptr<FunctionNode>;
@@ -76,24 +165,63 @@ namespace AST {
 
         // nullptr if no else block
         NodePtr elseStatement;
+        // Pre-order number among the ifs of the function as it was parsed, set by Profile::number. Copies made by
+        // the optimizations keep it, ifs they create have none.
+        std::optional<std::size_t> profile_index;
+        // The branch counter of an instrumented program, set by Profile::instrument
+        std::optional<std::size_t> profile_slot;
+        // Set by Profile::apply
+        Likelihood likelihood = Likelihood::Unknown;
 
         IfNode(NodePtr expression, NodePtr statement, NodePtr elseStatement):
         expression(std::move(expression)), statement(std::move(statement)), elseStatement(std::move(elseStatement)) {}
 
         void transpile(std::ostream &out) override;
+
+        [[nodiscard]] NodePtr clone() const override;
+
+        std::vector<NodePtr *> children() override;
     };
 
     using IfNodePtr = std::unique_ptr<IfNode>;
 
+    // An if used as a value
+    struct ConditionalNode : public Node {
+        NodePtr condition;
+        NodePtr then;
+        NodePtr otherwise;
+        // Both arms are evaluated and the result is selected without a branch, set by SelectLowering
+        bool branchless = false;
+        // Set by the TypeChecker
+        IntegerType type = IntegerType::Int;
+
+        ConditionalNode(NodePtr condition, NodePtr then, NodePtr otherwise):
+        condition(std::move(condition)), then(std::move(then)), otherwise(std::move(otherwise)) {}
+
+        void transpile(std::ostream &out) override;
+
+        [[nodiscard]] NodePtr clone() const override;
+
+        std::vector<NodePtr *> children() override;
+    };
+
+    using ConditionalNodePtr = std::unique_ptr<ConditionalNode>;
+
     struct DeclarationNode : public Node {
         Identifier name;
         // The expression the declaration equals
         NodePtr expression;
+        // Int if there was no annotation, then the TypeChecker gives it the type of the expression
+        IntegerType type;
 
-        DeclarationNode(Identifier name, NodePtr expression):
-        name(std::move(name)), expression(std::move(expression)) {}
+        DeclarationNode(Identifier name, NodePtr expression, IntegerType type = IntegerType::Int):
+        name(std::move(name)), expression(std::move(expression)), type(type) {}
 
         void transpile(std::ostream &out) override;
+
+        [[nodiscard]] NodePtr clone() const override;
+
+        std::vector<NodePtr *> children() override;
     };
 
     using DeclarationNodePtr = std::unique_ptr<DeclarationNode>;
@@ -104,6 +232,10 @@ namespace AST {
         explicit ReturnNode(NodePtr expression) : expression(std::move(expression)) {}
 
         void transpile(std::ostream &out) override;
+
+        [[nodiscard]] NodePtr clone() const override;
+
+        std::vector<NodePtr *> children() override;
     };
 
     using ReturnNodePtr = std::unique_ptr<ReturnNode>;
@@ -116,9 +248,105 @@ namespace AST {
         identifier(std::move(identifier)), arguments(std::move(arguments)) {}
 
         void transpile(std::ostream &out) override;
+
+        [[nodiscard]] NodePtr clone() const override;
+
+        std::vector<NodePtr *> children() override;
     };
 
     using FunctionCallPtr = std::unique_ptr<FunctionCall>;
+
+    struct BlockNode : public Node {
+        std::vector<NodePtr> statements;
+
+        explicit BlockNode(std::vector<NodePtr> statements) : statements(std::move(statements)) {}
+
+        void transpile(std::ostream &out) override;
+
+        [[nodiscard]] NodePtr clone() const override;
+
+        std::vector<NodePtr *> children() override;
+    };
+
+    using BlockNodePtr = std::unique_ptr<BlockNode>;
+
+    struct WhileNode : public Node {
+        // nullptr loops until a return
+        NodePtr condition;
+        NodePtr body;
+        // No iteration reads array elements another one writes, set by the LoopOptimizer
+        bool vectorize = false;
+
+        WhileNode(NodePtr condition, NodePtr body) : condition(std::move(condition)), body(std::move(body)) {}
+
+        void transpile(std::ostream &out) override;
+
+        [[nodiscard]] NodePtr clone() const override;
+
+        std::vector<NodePtr *> children() override;
+    };
+
+    using WhileNodePtr = std::unique_ptr<WhileNode>;
+
+    struct AssignmentNode : public Node {
+        // The array when an element is assigned
+        Identifier name;
+        NodePtr expression;
+        // The IndexNode of the assigned element, nullptr when assigning a variable
+        NodePtr element;
+
+        AssignmentNode(Identifier name, NodePtr expression, NodePtr element = nullptr) :
+        name(std::move(name)), expression(std::move(expression)), element(std::move(element)) {}
+
+        void transpile(std::ostream &out) override;
+
+        [[nodiscard]] NodePtr clone() const override;
+
+        std::vector<NodePtr *> children() override;
+    };
+
+    using AssignmentNodePtr = std::unique_ptr<AssignmentNode>;
+
+    // let name: [type; size];, zero initialized. On the stack when the size is a small enough literal.
+    struct ArrayDeclarationNode : public Node {
+        Identifier name;
+        IntegerType element_type;
+        NodePtr size;
+
+        ArrayDeclarationNode(Identifier name, IntegerType element_type, NodePtr size) :
+        name(std::move(name)), element_type(element_type), size(std::move(size)) {}
+
+        void transpile(std::ostream &out) override;
+
+        [[nodiscard]] NodePtr clone() const override;
+
+        std::vector<NodePtr *> children() override;
+    };
+
+    using ArrayDeclarationNodePtr = std::unique_ptr<ArrayDeclarationNode>;
+
+    struct IndexNode : public Node {
+        Identifier array;
+        NodePtr index;
+        // Out of bounds accesses abort, cleared by BoundsCheckElimination where the index is proven in bounds
+        bool checked = true;
+
+        IndexNode(Identifier array, NodePtr index) : array(std::move(array)), index(std::move(index)) {}
+
+        void transpile(std::ostream &out) override;
+
+        [[nodiscard]] NodePtr clone() const override;
+
+        std::vector<NodePtr *> children() override;
+    };
+
+    using IndexNodePtr = std::unique_ptr<IndexNode>;
+
+    struct ContinueNode : public Node {
+        void transpile(std::ostream &out) override;
+
+        [[nodiscard]] NodePtr clone() const override;
+    };
 }
 
 
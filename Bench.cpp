@@ -0,0 +1,182 @@
+// Measures the lexer, the parser and the transpiler on their own, over a generated program or a given file.
+// Each phase is run --iterations times after one warm-up run and reported as JSON: the percentiles of the time
+// one run took, and bytes, tokens and nodes per second at the median. The parse includes lexing, since the
+// parser pulls its tokens from the lexer, and the type checking that is done while parsing.
+
+#include "Generator.h"
+#include "Parser.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string_view>
+#include <vector>
+
+namespace {
+    struct Sizes {
+        std::size_t bytes = 0, tokens = 0, nodes = 0, output_bytes = 0;
+    };
+
+    struct Phase {
+        std::string name;
+        // Seconds per run, sorted
+        std::vector<double> seconds;
+    };
+
+    template<typename F>
+    Phase measure(std::string name, std::size_t iterations, F &&run) {
+        run();
+        Phase phase{std::move(name), {}};
+        for(std::size_t i = 0; i < iterations; ++i) {
+            auto start = std::chrono::steady_clock::now();
+            run();
+            phase.seconds.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        }
+        std::ranges::sort(phase.seconds);
+        return phase;
+    }
+
+    // Nearest rank
+    double percentile(const std::vector<double> &sorted, double p) {
+        auto rank = static_cast<std::size_t>(std::ceil(p * static_cast<double>(sorted.size())));
+        return sorted[std::clamp<std::size_t>(rank, 1, sorted.size()) - 1];
+    }
+
+    std::size_t lex(const std::string &source) {
+        Lexer lexer{std::istringstream(source)};
+        std::size_t tokens = 0;
+        while(lexer.getNextToken() != Token(EndToken()))
+            ++tokens;
+        return tokens;
+    }
+
+    std::size_t nodes(Parser &parser) {
+        std::size_t count = 0;
+        for(auto &function : parser.get_functions())
+            count += AST::size(*function);
+        return count;
+    }
+
+    void write_json(std::ostream &out, const ProgramGenerator::Options *generated, const std::string &input,
+                    const Sizes &sizes, std::size_t iterations, const std::vector<Phase> &phases) {
+        out << "{\n";
+        if(generated) {
+            out << "  \"generator\": {\"seed\": " << generated->seed << ", \"functions\": " << generated->functions
+                << ", \"statements\": " << generated->statements << ", \"expression_depth\": "
+                << generated->expression_depth << ", \"identifiers\": " << generated->identifiers << ", \"bytes\": "
+                << generated->bytes << "},\n";
+        } else {
+            // Paths are written as they are, so ones that need escaping give invalid JSON
+            out << "  \"input\": \"" << input << "\",\n";
+        }
+        out << "  \"bytes\": " << sizes.bytes << ",\n  \"tokens\": " << sizes.tokens << ",\n  \"nodes\": "
+            << sizes.nodes << ",\n  \"output_bytes\": " << sizes.output_bytes << ",\n  \"iterations\": "
+            << iterations << ",\n  \"phases\": {";
+        for(std::size_t i = 0; i < phases.size(); ++i) {
+            const auto &seconds = phases[i].seconds;
+            const auto median = percentile(seconds, 0.5);
+            out << (i ? "," : "") << "\n    \"" << phases[i].name << "\": {\n"
+                << "      \"seconds\": {\"min\": " << seconds.front() << ", \"p50\": " << median
+                << ", \"p90\": " << percentile(seconds, 0.9) << ", \"p99\": " << percentile(seconds, 0.99)
+                << ", \"max\": " << seconds.back() << "},\n"
+                << "      \"bytes_per_second\": " << static_cast<double>(sizes.bytes) / median << ",\n"
+                << "      \"tokens_per_second\": " << static_cast<double>(sizes.tokens) / median << ",\n"
+                << "      \"nodes_per_second\": " << static_cast<double>(sizes.nodes) / median << "\n    }";
+        }
+        out << "\n  }\n}\n";
+    }
+}
+
+int main(int argc, char *argv[]) {
+    ProgramGenerator::Options generator;
+    std::size_t iterations = 20;
+    std::string input, output, emit;
+    try {
+        for(int i = 1; i < argc; ++i) {
+            std::string_view arg = argv[i];
+            auto value = [&](std::string_view option) { return std::string(arg.substr(option.size())); };
+            if(arg.starts_with("--seed="))
+                generator.seed = std::stoull(value("--seed="));
+            else if(arg.starts_with("--functions="))
+                generator.functions = std::stoul(value("--functions="));
+            else if(arg.starts_with("--statements="))
+                generator.statements = std::stoul(value("--statements="));
+            else if(arg.starts_with("--depth="))
+                generator.expression_depth = std::stoul(value("--depth="));
+            else if(arg.starts_with("--identifiers="))
+                generator.identifiers = std::stoul(value("--identifiers="));
+            else if(arg.starts_with("--bytes="))
+                generator.bytes = std::stoul(value("--bytes="));
+            else if(arg.starts_with("--iterations="))
+                iterations = std::max(1ul, std::stoul(value("--iterations=")));
+            else if(arg.starts_with("--input="))
+                input = value("--input=");
+            else if(arg.starts_with("--output="))
+                output = value("--output=");
+            else if(arg.starts_with("--emit="))
+                emit = value("--emit=");
+            else {
+                std::cerr << arg << ": unknown option" << std::endl;
+                return 2;
+            }
+        }
+    } catch(const std::logic_error &) {
+        std::cerr << "option values have to be numbers" << std::endl;
+        return 2;
+    }
+
+    std::string source;
+    if(input.empty()) {
+        source = ProgramGenerator(generator).generate();
+    } else {
+        std::ifstream in(input);
+        if(!in) {
+            std::cerr << input << ": cannot read file" << std::endl;
+            return 1;
+        }
+        std::stringstream contents;
+        contents << in.rdbuf();
+        source = std::move(contents).str();
+    }
+    if(!emit.empty())
+        std::ofstream(emit) << source;
+
+    Sizes sizes;
+    std::vector<Phase> phases;
+    try {
+        // Transpiling doesn't change the tree, so this parse also serves every transpile run
+        Parser parsed{std::istringstream(source)};
+        parsed.parse_program();
+        std::ostringstream output_stream;
+        parsed.transpile(output_stream);
+        sizes = {source.size(), lex(source), nodes(parsed), output_stream.view().size()};
+
+        phases.push_back(measure("lex", iterations, [&] { lex(source); }));
+        phases.push_back(measure("parse", iterations, [&] {
+            Parser parser{std::istringstream(source)};
+            parser.parse_program();
+        }));
+        phases.push_back(measure("transpile", iterations, [&] {
+            std::ostringstream out;
+            parsed.transpile(out);
+        }));
+    } catch(const SyntaxErrorException &e) {
+        std::cerr << e.what() << ". At line " << e.getLine() << ", pos. " << e.getPosition() << '.' << std::endl;
+        return 1;
+    }
+
+    if(output.empty()) {
+        write_json(std::cout, input.empty() ? &generator : nullptr, input, sizes, iterations, phases);
+    } else {
+        std::ofstream out(output);
+        write_json(out, input.empty() ? &generator : nullptr, input, sizes, iterations, phases);
+        if(!out) {
+            std::cerr << output << ": cannot write file" << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
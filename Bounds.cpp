@@ -0,0 +1,428 @@
+#include "Bounds.h"
+#include "Types.h"
+#include <algorithm>
+#include <map>
+#include <optional>
+#include <set>
+#include <unordered_map>
+#include <utility>
+
+namespace {
+    class FunctionBounds {
+        using Wide = Types::Wide;
+
+        // The values an expression can have, type is nullopt if unknown
+        struct Range {
+            Wide lo, hi;
+            std::optional<IntegerType> type = std::nullopt;
+        };
+
+        struct Array {
+            IntegerType element_type;
+            std::optional<Wide> size = std::nullopt;
+            // The variable the array was sized with, empty if it isn't stable
+            Identifier size_variable = {};
+        };
+
+        struct State {
+            std::map<Identifier, Range> variables;
+            std::map<Identifier, Array> arrays;
+            // (i, n) for i < n
+            std::set<std::pair<Identifier, Identifier>> less;
+        };
+
+        const BoundsCheckElimination::Options &options;
+        AST::FunctionNode &function;
+        BoundsCheckElimination::Result &result;
+        const std::unordered_map<Identifier, IntegerType> &return_types;
+        // Declared once and never assigned, so the same value everywhere
+        std::unordered_map<Identifier, bool> stable;
+
+    public:
+        FunctionBounds(const BoundsCheckElimination::Options &options, AST::FunctionNode &function,
+                       const std::unordered_map<Identifier, IntegerType> &return_types,
+                       BoundsCheckElimination::Result &result) :
+        options(options), function(function), result(result), return_types(return_types) {}
+
+        void run() {
+            for(const auto &parameter : function.parameters)
+                declared(parameter);
+            AST::for_each(function, [&](AST::Node &node) {
+                if(auto *declaration = dynamic_cast<AST::DeclarationNode *>(&node))
+                    declared(declaration->name);
+                else if(auto *array = dynamic_cast<AST::ArrayDeclarationNode *>(&node))
+                    declared(array->name);
+                else if(auto *assignment = dynamic_cast<AST::AssignmentNode *>(&node); assignment && !assignment->element)
+                    stable[assignment->name] = false;
+            });
+
+            State state;
+            for(std::size_t i = 0; i < function.parameters.size(); ++i)
+                state.variables[function.parameters[i]] = full(function.parameter_types[i]);
+            for(auto &statement : function.statements)
+                analyze(*statement, state);
+            AST::for_each(function, [&](AST::Node &node) {
+                if(auto *element = dynamic_cast<AST::IndexNode *>(&node))
+                    ++(element->checked ? result.kept : result.removed);
+            });
+        }
+
+    private:
+        void declared(const Identifier &name) {
+            auto [it, inserted] = stable.try_emplace(name, true);
+            if(!inserted)
+                it->second = false;
+        }
+
+        [[nodiscard]] bool is_stable(const Identifier &name) const {
+            auto it = stable.find(name);
+            return it != stable.end() && it->second;
+        }
+
+        static Range full(IntegerType type) {
+            return {Types::min(type), Types::max(type), type};
+        }
+
+        static Range unknown() {
+            return {Types::min(IntegerType::I64), Types::max(IntegerType::U64), std::nullopt};
+        }
+
+        static bool assigns(AST::Node &node, const Identifier &name) {
+            bool found = false;
+            AST::for_each(node, [&](AST::Node &child) {
+                auto *assignment = dynamic_cast<AST::AssignmentNode *>(&child);
+                found = found || (assignment && !assignment->element && assignment->name == name);
+            });
+            return found;
+        }
+
+        static bool is_unsigned(IntegerType type) {
+            return Types::min(type) == 0;
+        }
+
+        // Values outside the type wrap around or overflow, so they could be anything the type holds
+        static Range fit(Range range, std::optional<IntegerType> type) {
+            if(!type)
+                return unknown();
+            range.type = type;
+            if(range.lo < Types::min(*type) || range.hi > Types::max(*type))
+                return full(*type);
+            return range;
+        }
+
+        static State join(const State &a, const State &b) {
+            State joined;
+            for(const auto &[name, range] : a.variables) {
+                auto it = b.variables.find(name);
+                if(it == b.variables.end())
+                    continue;
+                joined.variables[name] = {std::min(range.lo, it->second.lo), std::max(range.hi, it->second.hi),
+                                          range.type};
+            }
+            for(const auto &[name, array] : a.arrays) {
+                auto it = b.arrays.find(name);
+                if(it != b.arrays.end() && it->second.size == array.size
+                   && it->second.size_variable == array.size_variable)
+                    joined.arrays.emplace(name, array);
+            }
+            std::ranges::set_intersection(a.less, b.less, std::inserter(joined.less, joined.less.end()));
+            return joined;
+        }
+
+        static void forget(State &state, const Identifier &name) {
+            std::erase_if(state.less, [&](const auto &fact) { return fact.first == name || fact.second == name; });
+        }
+
+        Range evaluate(AST::Node &node, const State &state) {
+            if(auto *literal = dynamic_cast<AST::IntegerLiteralNode *>(&node))
+                return {Wide(literal->value), Wide(literal->value), Types::literal(literal->value)};
+            if(auto *id = dynamic_cast<AST::IdentifierNode *>(&node)) {
+                auto it = state.variables.find(id->identifier);
+                return it == state.variables.end() ? unknown() : it->second;
+            }
+            if(auto *element = dynamic_cast<AST::IndexNode *>(&node))
+                return access(*element, state);
+            if(auto *call = dynamic_cast<AST::FunctionCall *>(&node)) {
+                for(auto &argument : call->arguments)
+                    evaluate(*argument, state);
+                auto it = return_types.find(call->identifier);
+                return it == return_types.end() ? unknown() : full(it->second);
+            }
+            if(auto *conditional = dynamic_cast<AST::ConditionalNode *>(&node)) {
+                evaluate(*conditional->condition, state);
+                auto then = evaluate(*conditional->then, refine(*conditional->condition, state, true));
+                auto otherwise = evaluate(*conditional->otherwise, refine(*conditional->condition, state, false));
+                return fit({std::min(then.lo, otherwise.lo), std::max(then.hi, otherwise.hi)}, conditional->type);
+            }
+            auto &binary = dynamic_cast<AST::BinaryOpNode &>(node);
+            auto left = evaluate(*binary.left, state);
+            // The right operand of && and || is only evaluated when the left one didn't decide
+            auto right = binary.op == Operator::LogicalAnd || binary.op == Operator::LogicalOr
+                         ? evaluate(*binary.right, refine(*binary.left, state, binary.op == Operator::LogicalAnd))
+                         : evaluate(*binary.right, state);
+            if(!Types::is_arithmetic(binary.op))
+                return {0, 1, IntegerType::Int};
+            if(!left.type || !right.type)
+                return unknown();
+            // Past 64 bits the products could overflow the 128
+            bool wide = left.hi > Types::max(IntegerType::I64) || right.hi > Types::max(IntegerType::I64);
+            auto type = Types::arithmetic(*left.type, *right.type);
+            switch(binary.op) {
+                case Operator::Add:
+                    return fit({left.lo + right.lo, left.hi + right.hi}, type);
+                case Operator::Subtract:
+                    return fit({left.lo - right.hi, left.hi - right.lo}, type);
+                case Operator::Multiply: {
+                    if(wide)
+                        return full(type);
+                    Wide products[] = {left.lo * right.lo, left.lo * right.hi, left.hi * right.lo, left.hi * right.hi};
+                    return fit({*std::ranges::min_element(products), *std::ranges::max_element(products)}, type);
+                }
+                case Operator::Divide:
+                    if(left.lo >= 0 && right.lo > 0)
+                        return fit({left.lo / right.hi, left.hi / right.lo}, type);
+                    return full(type);
+                default:
+                    if(left.lo >= 0 && right.lo > 0)
+                        return fit({0, std::min(left.hi, right.hi - 1)}, type);
+                    return full(type);
+            }
+        }
+
+        Range access(AST::IndexNode &element, const State &state) {
+            auto index = evaluate(*element.index, state);
+            auto array = state.arrays.find(element.array);
+            if(array == state.arrays.end())
+                return unknown();
+            auto *id = dynamic_cast<AST::IdentifierNode *>(element.index.get());
+            bool in_range = index.lo >= 0
+                            && ((array->second.size && index.hi < *array->second.size)
+                                || (id && !array->second.size_variable.empty()
+                                    && state.less.contains({id->identifier, array->second.size_variable})));
+            // Evaluated once for every state it's reached in, all of which have to be in range
+            if(in_range)
+                element.checked = false;
+            return full(array->second.element_type);
+        }
+
+        // The state when condition is known to be truth
+        State refine(AST::Node &condition, State state, bool truth) {
+            auto *binary = dynamic_cast<AST::BinaryOpNode *>(&condition);
+            if(!binary)
+                return state;
+            if(binary->op == Operator::LogicalAnd || binary->op == Operator::LogicalOr) {
+                bool both = truth == (binary->op == Operator::LogicalAnd);
+                auto left = refine(*binary->left, state, truth);
+                if(both)
+                    return refine(*binary->right, std::move(left), truth);
+                auto right = refine(*binary->right, refine(*binary->left, std::move(state), !truth), truth);
+                return join(left, right);
+            }
+            auto op = binary->op;
+            if(!truth) {
+                switch(op) {
+                    case Operator::LessThan: op = Operator::GreaterThanOrEq; break;
+                    case Operator::LessThanOrEq: op = Operator::GreaterThan; break;
+                    case Operator::GreaterThan: op = Operator::LessThanOrEq; break;
+                    case Operator::GreaterThanOrEq: op = Operator::LessThan; break;
+                    case Operator::Equal: op = Operator::NotEqual; break;
+                    case Operator::NotEqual: op = Operator::Equal; break;
+                    default: return state;
+                }
+            }
+            auto mirrored = op;
+            switch(op) {
+                case Operator::LessThan: mirrored = Operator::GreaterThan; break;
+                case Operator::LessThanOrEq: mirrored = Operator::GreaterThanOrEq; break;
+                case Operator::GreaterThan: mirrored = Operator::LessThan; break;
+                case Operator::GreaterThanOrEq: mirrored = Operator::LessThanOrEq; break;
+                default: break;
+            }
+            auto left = evaluate(*binary->left, state);
+            auto right = evaluate(*binary->right, state);
+            compare(*binary->left, op, right, *binary->right, state);
+            compare(*binary->right, mirrored, left, *binary->left, state);
+            return state;
+        }
+
+        // Narrows the variable on the left of side op other
+        void compare(AST::Node &side, Operator op, const Range &other, AST::Node &other_node, State &state) {
+            auto *id = dynamic_cast<AST::IdentifierNode *>(&side);
+            if(!id)
+                return;
+            auto it = state.variables.find(id->identifier);
+            if(it == state.variables.end())
+                return;
+            auto &range = it->second;
+            switch(op) {
+                case Operator::LessThan: range.hi = std::min(range.hi, other.hi - 1); break;
+                case Operator::LessThanOrEq: range.hi = std::min(range.hi, other.hi); break;
+                case Operator::GreaterThan: range.lo = std::max(range.lo, other.lo + 1); break;
+                case Operator::GreaterThanOrEq: range.lo = std::max(range.lo, other.lo); break;
+                case Operator::Equal:
+                    range.lo = std::max(range.lo, other.lo);
+                    range.hi = std::min(range.hi, other.hi);
+                    break;
+                default: break;
+            }
+            auto *bound = dynamic_cast<AST::IdentifierNode *>(&other_node);
+            if(options.relations && op == Operator::LessThan && bound && is_stable(bound->identifier))
+                state.less.emplace(id->identifier, bound->identifier);
+        }
+
+        // v = v + c or v = v - c for a literal c, as +c or -c
+        static std::optional<Wide> step(AST::AssignmentNode &assignment) {
+            auto *binary = dynamic_cast<AST::BinaryOpNode *>(assignment.expression.get());
+            if(!binary || (binary->op != Operator::Add && binary->op != Operator::Subtract))
+                return std::nullopt;
+            auto *id = dynamic_cast<AST::IdentifierNode *>(binary->left.get());
+            auto *literal = dynamic_cast<AST::IntegerLiteralNode *>(binary->right.get());
+            if(!id || id->identifier != assignment.name || !literal)
+                return std::nullopt;
+            return binary->op == Operator::Add ? Wide(literal->value) : -Wide(literal->value);
+        }
+
+        // Every state the head of the loop can be in, from the state it's entered in
+        static void widen(AST::Node &body, State &state) {
+            // -1 only decreased, 1 only increased, 0 anything else
+            std::map<Identifier, int> directions;
+            AST::for_each(body, [&](AST::Node &node) {
+                auto *assignment = dynamic_cast<AST::AssignmentNode *>(&node);
+                if(!assignment || assignment->element)
+                    return;
+                auto change = step(*assignment);
+                int direction = !change ? 0 : *change >= 0 ? 1 : -1;
+                auto [it, inserted] = directions.try_emplace(assignment->name, direction);
+                if(!inserted && it->second != direction)
+                    it->second = 0;
+            });
+            for(const auto &[name, direction] : directions) {
+                auto it = state.variables.find(name);
+                if(it == state.variables.end())
+                    continue;
+                auto &range = it->second;
+                if(!range.type) {
+                    forget(state, name);
+                    continue;
+                }
+                bool wraps = is_unsigned(*range.type);
+                if(direction == 1 && !wraps) {
+                    range.hi = Types::max(*range.type);
+                } else if(direction == -1 && !wraps) {
+                    range.lo = Types::min(*range.type);
+                    continue;
+                } else {
+                    range = full(*range.type);
+                }
+                forget(state, name);
+            }
+        }
+
+        // Whether the statement always returns
+        bool analyze(AST::Node &node, State &state) {
+            if(auto *declaration = dynamic_cast<AST::DeclarationNode *>(&node)) {
+                auto value = evaluate(*declaration->expression, state);
+                forget(state, declaration->name);
+                state.arrays.erase(declaration->name);
+                state.variables[declaration->name] = fit(value, declaration->type);
+            } else if(auto *array = dynamic_cast<AST::ArrayDeclarationNode *>(&node)) {
+                auto size = evaluate(*array->size, state);
+                forget(state, array->name);
+                state.variables.erase(array->name);
+                Array declared{array->element_type};
+                if(size.lo == size.hi)
+                    declared.size = size.lo;
+                if(auto *id = dynamic_cast<AST::IdentifierNode *>(array->size.get()); id && is_stable(id->identifier))
+                    declared.size_variable = id->identifier;
+                state.arrays.insert_or_assign(array->name, declared);
+            } else if(auto *assignment = dynamic_cast<AST::AssignmentNode *>(&node)) {
+                if(assignment->element)
+                    evaluate(*assignment->element, state);
+                auto value = evaluate(*assignment->expression, state);
+                if(assignment->element)
+                    return false;
+                auto it = state.variables.find(assignment->name);
+                if(it == state.variables.end())
+                    return false;
+                auto &range = it->second;
+                auto change = step(*assignment);
+                // Decreasing without wrapping keeps it below whatever it was below
+                if(!change || *change > 0 || !range.type || range.lo + *change < Types::min(*range.type))
+                    forget(state, assignment->name);
+                range = fit(value, range.type);
+            } else if(auto *statement = dynamic_cast<AST::IfNode *>(&node)) {
+                evaluate(*statement->expression, state);
+                auto then = refine(*statement->expression, state, true);
+                auto otherwise = refine(*statement->expression, std::move(state), false);
+                bool then_returns = analyze(*statement->statement, then);
+                bool otherwise_returns = statement->elseStatement && analyze(*statement->elseStatement, otherwise);
+                if(then_returns && otherwise_returns)
+                    return true;
+                state = then_returns ? std::move(otherwise) : otherwise_returns ? std::move(then) : join(then, otherwise);
+            } else if(auto *loop = dynamic_cast<AST::WhileNode *>(&node)) {
+                widen(*loop->body, state);
+                if(!loop->condition) {
+                    analyze(*loop->body, state);
+                    return false;
+                }
+                evaluate(*loop->condition, state);
+                auto body = refine(*loop->condition, state, true);
+                analyze(*loop->body, body);
+                state = refine(*loop->condition, std::move(state), false);
+            } else if(auto *block = dynamic_cast<AST::BlockNode *>(&node)) {
+                auto outer = state;
+                bool returns = false;
+                for(auto &statement : block->statements)
+                    returns = analyze(*statement, state) || returns;
+                // Declarations in the block go out of scope, what was assigned to outer variables stays
+                for(auto &statement : block->statements) {
+                    Identifier name;
+                    if(auto *declaration = dynamic_cast<AST::DeclarationNode *>(statement.get()))
+                        name = declaration->name;
+                    else if(auto *array = dynamic_cast<AST::ArrayDeclarationNode *>(statement.get()))
+                        name = array->name;
+                    else
+                        continue;
+                    forget(state, name);
+                    auto it = outer.variables.find(name);
+                    if(it == outer.variables.end())
+                        continue;
+                    // Assignments before the declaration were to the outer one
+                    bool assigned = it->second.type && assigns(*block, name);
+                    state.variables[name] = assigned ? full(*it->second.type) : it->second;
+                }
+                std::erase_if(state.variables, [&](const auto &entry) { return !outer.variables.contains(entry.first); });
+                state.arrays = std::move(outer.arrays);
+                return returns;
+            } else if(auto *ret = dynamic_cast<AST::ReturnNode *>(&node)) {
+                evaluate(*ret->expression, state);
+                return true;
+            } else if(!dynamic_cast<AST::ContinueNode *>(&node)) {
+                evaluate(node, state);
+            }
+            return false;
+        }
+    };
+}
+
+BoundsCheckElimination &BoundsCheckElimination::run(std::vector<AST::FunctionNodePtr> &functions) {
+    std::unordered_map<Identifier, IntegerType> return_types;
+    for(const auto &function : functions)
+        return_types[function->name] = function->return_type;
+    for(auto &function : functions) {
+        if(!AST::contains_array(*function))
+            continue;
+        Result result{function->name};
+        FunctionBounds(options, *function, return_types, result).run();
+        if(result.removed || result.kept)
+            results.push_back(std::move(result));
+    }
+    return *this;
+}
+
+void BoundsCheckElimination::print_report(std::ostream &out) const {
+    for(const auto &result : results) {
+        out << "bounds: " << result.function << ": " << result.removed << " of " << result.removed + result.kept
+            << " checks removed\n";
+    }
+}
@@ -0,0 +1,44 @@
+#pragma once
+#ifndef COMPILER_BOUNDS_H
+#define COMPILER_BOUNDS_H
+
+#include "ASTNode.h"
+#include <ostream>
+#include <vector>
+
+// Removes the bounds check of every element access whose index is known to be in range.
+// Tracks the range of every variable through the function, starting from its type and narrowed by the
+// conditions of ifs and loops. At the head of a loop a variable the body only increases keeps its lower bound,
+// one it only decreases keeps its upper bound and any other it assigns can be anything its type holds.
+// An index is in range if its range fits the size of the array, or if it's a variable that is less than the
+// variable the array was sized with, as in for (let i = 0; i < n; i = i + 1) a[i], when neither is assigned
+// in between and the size is never assigned at all.
+class BoundsCheckElimination {
+public:
+    struct Options {
+        // Use relations like i < n between variables, not just the range of each
+        bool relations = true;
+    };
+
+    struct Result {
+        Identifier function;
+        std::size_t removed = 0, kept = 0;
+    };
+
+private:
+    Options options;
+    std::vector<Result> results;
+
+public:
+    BoundsCheckElimination() = default;
+
+    explicit BoundsCheckElimination(Options options) : options(options) {}
+
+    BoundsCheckElimination &run(std::vector<AST::FunctionNodePtr> &functions);
+
+    [[nodiscard]] const std::vector<Result> &report() const { return results; }
+
+    void print_report(std::ostream &) const;
+};
+
+#endif //COMPILER_BOUNDS_H
@@ -0,0 +1,305 @@
+#include "Build.h"
+#include "Module.h"
+#include "Parallel.h"
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include <thread>
+
+namespace {
+    std::optional<std::string> read_file(const std::filesystem::path &path) {
+        std::ifstream in(path);
+        if(!in)
+            return std::nullopt;
+        std::stringstream source;
+        source << in.rdbuf();
+        return std::move(source).str();
+    }
+
+    void report(std::ostream &out, const std::filesystem::path &path, const SyntaxErrorException &e) {
+        out << path.string() << ": " << e.what() << ". At line " << e.getLine() << ", pos. " << e.getPosition()
+            << ".\n";
+    }
+
+    bool matches_wildcard(std::string_view pattern, std::string_view name) {
+        // Where the last * started and how much of the name it has taken so far
+        std::size_t star = std::string_view::npos, taken = 0, p = 0, n = 0;
+        while(n < name.size()) {
+            if(p < pattern.size() && (pattern[p] == '?' || pattern[p] == name[n])) {
+                ++p, ++n;
+            } else if(p < pattern.size() && pattern[p] == '*') {
+                star = p++;
+                taken = n;
+            } else if(star != std::string_view::npos) {
+                p = star + 1;
+                n = ++taken;
+            } else {
+                return false;
+            }
+        }
+        while(p < pattern.size() && pattern[p] == '*')
+            ++p;
+        return p == pattern.size();
+    }
+
+    bool has_wildcard(std::string_view component) {
+        return component.find_first_of("*?") != std::string_view::npos;
+    }
+
+    void expand_glob(const std::filesystem::path &base, const std::vector<std::string> &components, std::size_t i,
+              std::vector<std::filesystem::path> &found) {
+        auto child = [&](const std::string &name) { return base.empty() ? std::filesystem::path(name) : base / name; };
+        std::error_code error;
+        if(i == components.size()) {
+            if(std::filesystem::is_regular_file(base, error))
+                found.push_back(base);
+            return;
+        }
+        if(!has_wildcard(components[i])) {
+            expand_glob(child(components[i]), components, i + 1, found);
+            return;
+        }
+        const bool any_depth = components[i] == "**";
+        if(any_depth)
+            expand_glob(base, components, i + 1, found);
+        for(const auto &entry : std::filesystem::directory_iterator(base.empty() ? "." : base, error)) {
+            auto name = entry.path().filename().string();
+            if(any_depth && entry.is_directory(error))
+                expand_glob(child(name), components, i, found);
+            else if(!any_depth && matches_wildcard(components[i], name))
+                expand_glob(child(name), components, i + 1, found);
+        }
+    }
+}
+
+bool ProgramBuilder::build(const std::vector<std::filesystem::path> &sources, std::ostream &diagnostics) {
+    const auto jobs = options.jobs ? options.jobs : std::max(1u, std::thread::hardware_concurrency());
+    std::filesystem::create_directories(options.output_directory);
+
+    std::vector<Identifier> modules;
+    for(const auto &path : sources)
+        modules.push_back(path.stem().string());
+    for(std::size_t i = 0; i < modules.size(); ++i) {
+        for(std::size_t j = 0; j < i; ++j) {
+            if(modules[i] == modules[j]) {
+                diagnostics << sources[i].string() << ": module " << modules[i] << " is also defined by "
+                            << sources[j].string() << '\n';
+                return false;
+            }
+        }
+    }
+
+    // Interfaces first, every module needs the interfaces of its imports before it can be compiled
+    std::vector<std::optional<std::string>> files(sources.size());
+    std::vector<std::optional<Interface>> scanned(sources.size());
+    std::vector<std::ostringstream> messages(sources.size());
+    parallel_for(sources.size(), jobs, [&](std::size_t i) {
+        files[i] = read_file(sources[i]);
+        if(!files[i]) {
+            messages[i] << sources[i].string() << ": cannot read file\n";
+            return;
+        }
+        try {
+            scanned[i] = Interface::scan(modules[i], *files[i]);
+        } catch(const SyntaxErrorException &) {
+            // Reported with its position when the module is compiled
+            return;
+        } catch(const std::exception &e) {
+            messages[i] << sources[i].string() << ": " << e.what() << '\n';
+            files[i].reset();
+            return;
+        }
+        std::ofstream out(options.output_directory / (modules[i] + ".arji"));
+        scanned[i]->write(out);
+    });
+
+    interfaces.clear();
+    for(auto &interface : scanned) {
+        if(interface)
+            interfaces.emplace(interface->module, std::move(*interface));
+    }
+    // Precompiled interfaces are only loaded if something imports them
+    std::vector<Identifier> linked = modules;
+    for(std::size_t i = 0; i < linked.size(); ++i) {
+        auto it = interfaces.find(linked[i]);
+        if(it == interfaces.end())
+            continue;
+        for(const auto &import : it->second.imports) {
+            if(interfaces.contains(import) || options.interface_directory.empty())
+                continue;
+            std::ifstream in(options.interface_directory / (import + ".arji"));
+            if(!in)
+                continue;
+            try {
+                interfaces.emplace(import, Interface::read(in));
+                linked.push_back(import);
+            } catch(const std::exception &e) {
+                diagnostics << (options.interface_directory / (import + ".arji")).string() << ": " << e.what()
+                            << '\n';
+            }
+        }
+    }
+
+    // The interfaces are only read from here on, so the resolver can be shared by all threads
+    const Parser::ImportResolver resolver = [this](const Identifier &module) {
+        auto it = interfaces.find(module);
+        if(it == interfaces.end())
+            throw SyntaxErrorException("Unknown module " + module);
+        return it->second.functions;
+    };
+    std::vector<bool> compiled(sources.size());
+    parallel_for(sources.size(), jobs, [&](std::size_t i) {
+        if(!files[i])
+            return;
+        std::ostringstream code;
+        try {
+            Compiler(compile_options).compile_module(*files[i], resolver, code, messages[i]);
+        } catch(const SyntaxErrorException &e) {
+            report(messages[i], sources[i], e);
+            return;
+        } catch(const std::exception &e) {
+            messages[i] << sources[i].string() << ": " << e.what() << '\n';
+            return;
+        }
+        std::ofstream out(options.output_directory / (modules[i] + ".cpp"));
+        out << code.str();
+        compiled[i] = static_cast<bool>(out);
+        if(!compiled[i])
+            messages[i] << sources[i].string() << ": cannot write output\n";
+    });
+
+    for(auto &message : messages)
+        diagnostics << message.str();
+    if(!std::ranges::all_of(compiled, [](bool ok) { return ok; }))
+        return false;
+    return link(linked, diagnostics);
+}
+
+bool ProgramBuilder::link(const std::vector<Identifier> &modules, std::ostream &diagnostics) const {
+    bool ok = true;
+    std::unordered_map<Identifier, Identifier> defined_in;
+    std::vector<Identifier> mains;
+    for(const auto &module : modules) {
+        const auto &interface = interfaces.at(module);
+        for(const auto &[name, signature] : interface.functions) {
+            auto [it, inserted] = defined_in.emplace(name, module);
+            if(!inserted) {
+                diagnostics << "link: " << name << " is defined in both " << it->second << " and " << module << '\n';
+                ok = false;
+            }
+            if(name == "main")
+                mains.push_back(module);
+        }
+        for(const auto &import : interface.imports) {
+            if(!interfaces.contains(import)) {
+                diagnostics << "link: " << module << " imports unknown module " << import << '\n';
+                ok = false;
+            }
+        }
+    }
+    if(mains.empty())
+        diagnostics << "link: no module defines main, the output can only be used as a library\n";
+    return ok;
+}
+
+bool BatchCompiler::expand(const std::vector<std::string> &inputs, std::vector<std::filesystem::path> &paths,
+                           std::ostream &diagnostics) {
+    bool ok = true;
+    for(const auto &input : inputs) {
+        if(input.starts_with('@')) {
+            std::ifstream list(input.substr(1));
+            if(!list) {
+                diagnostics << input.substr(1) << ": cannot read file list\n";
+                ok = false;
+                continue;
+            }
+            std::vector<std::string> listed;
+            for(std::string line; std::getline(list, line);) {
+                if(!line.empty())
+                    listed.push_back(std::move(line));
+            }
+            ok = expand(listed, paths, diagnostics) && ok;
+        } else if(has_wildcard(input)) {
+            std::filesystem::path pattern(input);
+            std::vector<std::string> components;
+            for(const auto &component : pattern.relative_path())
+                components.push_back(component.string());
+            std::vector<std::filesystem::path> found;
+            expand_glob(pattern.root_path(), components, 0, found);
+            if(found.empty()) {
+                diagnostics << input << ": no files match\n";
+                ok = false;
+            }
+            std::ranges::sort(found);
+            paths.insert(paths.end(), found.begin(), found.end());
+        } else {
+            paths.emplace_back(input);
+        }
+    }
+    return ok;
+}
+
+std::filesystem::path BatchCompiler::output_path(const std::filesystem::path &source) const {
+    auto relative = source.lexically_normal();
+    if(relative.is_absolute() || (!relative.empty() && *relative.begin() == ".."))
+        relative = relative.filename();
+    return (options.output_directory / relative).replace_extension(".cpp");
+}
+
+BatchCompiler::Result BatchCompiler::compile(const std::vector<std::filesystem::path> &sources,
+                                             std::ostream &diagnostics) {
+    const auto jobs = options.jobs ? options.jobs : std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::filesystem::path> outputs;
+    std::unordered_map<std::string, std::size_t> written_by;
+    std::vector<std::ostringstream> messages(sources.size());
+    std::vector<bool> skipped(sources.size());
+    for(std::size_t i = 0; i < sources.size(); ++i) {
+        outputs.push_back(output_path(sources[i]));
+        auto [it, inserted] = written_by.emplace(outputs[i].string(), i);
+        if(!inserted) {
+            messages[i] << sources[i].string() << ": output " << outputs[i].string() << " is also written by "
+                        << sources[it->second].string() << '\n';
+            skipped[i] = true;
+        }
+    }
+
+    std::vector<bool> compiled(sources.size());
+    parallel_for(sources.size(), jobs, [&](std::size_t i) {
+        if(skipped[i])
+            return;
+        std::ostringstream code;
+        try {
+            if(compile_options.from_module) {
+                compiler.compile(Module(sources[i]), code, messages[i]);
+            } else {
+                auto file = read_file(sources[i]);
+                if(!file) {
+                    messages[i] << sources[i].string() << ": cannot read file\n";
+                    return;
+                }
+                compiler.compile(*file, code, messages[i]);
+            }
+        } catch(const SyntaxErrorException &e) {
+            report(messages[i], sources[i], e);
+            return;
+        } catch(const std::exception &e) {
+            messages[i] << sources[i].string() << ": " << e.what() << '\n';
+            return;
+        }
+        std::error_code error;
+        std::filesystem::create_directories(outputs[i].parent_path(), error);
+        std::ofstream out(outputs[i]);
+        out << code.str();
+        compiled[i] = static_cast<bool>(out);
+        if(!compiled[i])
+            messages[i] << sources[i].string() << ": cannot write " << outputs[i].string() << '\n';
+    });
+
+    Result result;
+    for(std::size_t i = 0; i < sources.size(); ++i) {
+        diagnostics << messages[i].str();
+        ++(compiled[i] ? result.compiled : result.failed);
+    }
+    diagnostics << "batch: " << result.compiled << " compiled, " << result.failed << " failed\n";
+    return result;
+}
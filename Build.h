@@ -0,0 +1,81 @@
+#pragma once
+#ifndef COMPILER_BUILD_H
+#define COMPILER_BUILD_H
+
+#include "Compiler.h"
+#include "Interface.h"
+#include <cstddef>
+#include <filesystem>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Builds a program made of several modules, one source file each, named after the file stem.
+// Every module is compiled on its own to output_directory/name.cpp together with its interface name.arji.
+// Imports are resolved against the interfaces of the other sources, or against precompiled interfaces in
+// interface_directory, so the generated files can be compiled and linked like any C++ files.
+class ProgramBuilder {
+public:
+    struct Options {
+        std::filesystem::path output_directory;
+        // Where interfaces of modules that aren't being built are looked up, empty to only use the sources
+        std::filesystem::path interface_directory;
+        // 0 uses one thread per core
+        std::size_t jobs = 0;
+    };
+
+private:
+    CompileOptions compile_options;
+    Options options;
+    std::unordered_map<Identifier, Interface> interfaces;
+
+public:
+    ProgramBuilder(CompileOptions compile_options, Options options)
+            : compile_options(std::move(compile_options)), options(std::move(options)) {}
+
+    // Returns false if a module failed to compile or the modules don't link
+    bool build(const std::vector<std::filesystem::path> &sources, std::ostream &diagnostics);
+
+private:
+    // Every import resolves, no function is defined twice and there is at most one main
+    bool link(const std::vector<Identifier> &modules, std::ostream &diagnostics) const;
+};
+
+// Compiles many independent programs in one process, each on its own to output_directory. Every thread compiles
+// one file at a time with its own Parser, sharing the Compiler and its cache.
+class BatchCompiler {
+public:
+    struct Options {
+        std::filesystem::path output_directory;
+        // 0 uses one thread per core
+        std::size_t jobs = 0;
+    };
+
+    struct Result {
+        std::size_t compiled = 0, failed = 0;
+    };
+
+private:
+    Compiler compiler;
+    CompileOptions compile_options;
+    Options options;
+
+public:
+    BatchCompiler(CompileOptions compile_options, Options options)
+            : compiler(compile_options), compile_options(std::move(compile_options)), options(std::move(options)) {}
+
+    // Paths, globs where * and ? match within a name and ** matches any number of directories, and @file for a
+    // file listing one of those per line. Reports globs that match nothing and returns false if there were any.
+    static bool expand(const std::vector<std::string> &inputs, std::vector<std::filesystem::path> &paths,
+                       std::ostream &diagnostics);
+
+    // A relative source is written to the same relative path in output_directory with a .cpp extension,
+    // anything else to its file name. Diagnostics are written in the order of the sources.
+    Result compile(const std::vector<std::filesystem::path> &sources, std::ostream &diagnostics);
+
+    // Where the output of source goes
+    [[nodiscard]] std::filesystem::path output_path(const std::filesystem::path &source) const;
+};
+
+#endif //COMPILER_BUILD_H
@@ -0,0 +1,89 @@
+#include "CallGraph.h"
+#include <algorithm>
+
+CallGraph::CallGraph(const std::vector<AST::FunctionNodePtr> &functions) {
+    for(const auto &function : functions) {
+        nodes[function->name] = function.get();
+        auto &counts = edges[function->name];
+        AST::for_each(*function, [&](AST::Node &node) {
+            if(auto *call = dynamic_cast<AST::FunctionCall *>(&node)) {
+                ++counts[call->identifier];
+                ++sites[call->identifier];
+            }
+        });
+    }
+
+    // Tarjan's algorithm, visiting functions in declaration order so the result is deterministic
+    std::unordered_map<Identifier, std::pair<std::size_t, std::size_t>> index; // name -> (index, lowlink)
+    std::vector<Identifier> stack;
+    std::size_t counter = 0;
+    for(const auto &function : functions) {
+        if(!index.contains(function->name))
+            strong_connect(function->name, index, stack, counter);
+    }
+}
+
+void CallGraph::strong_connect(const Identifier &name,
+                               std::unordered_map<Identifier, std::pair<std::size_t, std::size_t>> &index,
+                               std::vector<Identifier> &stack, std::size_t &counter) {
+    index[name] = {counter, counter};
+    ++counter;
+    stack.push_back(name);
+
+    // Sort the callees so the traversal does not depend on hash order
+    std::vector<Identifier> targets;
+    for(const auto &[callee, count] : edges[name]) {
+        if(nodes.contains(callee))
+            targets.push_back(callee);
+    }
+    std::sort(targets.begin(), targets.end());
+
+    for(const auto &callee : targets) {
+        if(!index.contains(callee)) {
+            strong_connect(callee, index, stack, counter);
+            index[name].second = std::min(index[name].second, index[callee].second);
+        } else if(std::find(stack.begin(), stack.end(), callee) != stack.end()) {
+            index[name].second = std::min(index[name].second, index[callee].first);
+        }
+    }
+
+    if(index[name].first == index[name].second) {
+        std::vector<Identifier> scc;
+        Identifier member;
+        do {
+            member = std::move(stack.back());
+            stack.pop_back();
+            component[member] = components.size();
+            scc.push_back(member);
+        } while(member != name);
+        components.push_back(std::move(scc));
+    }
+}
+
+const CallGraph::CallCounts &CallGraph::callees(const Identifier &caller) const {
+    static const CallCounts none;
+    auto it = edges.find(caller);
+    return it == edges.end() ? none : it->second;
+}
+
+std::size_t CallGraph::call_sites(const Identifier &callee) const {
+    auto it = sites.find(callee);
+    return it == sites.end() ? 0 : it->second;
+}
+
+bool CallGraph::is_recursive(const Identifier &function) const {
+    auto it = component.find(function);
+    if(it == component.end())
+        return false;
+    return components[it->second].size() > 1 || callees(function).contains(function);
+}
+
+bool CallGraph::same_component(const Identifier &a, const Identifier &b) const {
+    auto first = component.find(a), second = component.find(b);
+    return first != component.end() && second != component.end() && first->second == second->second;
+}
+
+AST::FunctionNode *CallGraph::function(const Identifier &name) const {
+    auto it = nodes.find(name);
+    return it == nodes.end() ? nullptr : it->second;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#ifndef COMPILER_CALLGRAPH_H
+#define COMPILER_CALLGRAPH_H
+
+#include "ASTNode.h"
+#include <vector>
+#include <unordered_map>
+
+// Static call graph over the top-level functions of a program.
+// Builtins such as print appear as callees but have no FunctionNode.
+class CallGraph {
+public:
+    using CallCounts = std::unordered_map<Identifier, std::size_t>;
+
+private:
+    std::unordered_map<Identifier, AST::FunctionNode *> nodes;
+    std::unordered_map<Identifier, CallCounts> edges;
+    std::unordered_map<Identifier, std::size_t> sites;
+    std::unordered_map<Identifier, std::size_t> component;
+    std::vector<std::vector<Identifier>> components;
+
+public:
+    explicit CallGraph(const std::vector<AST::FunctionNodePtr> &functions);
+
+    // Number of call sites in caller for every function it calls
+    [[nodiscard]] const CallCounts &callees(const Identifier &caller) const;
+
+    // Number of call sites of callee in the whole program
+    [[nodiscard]] std::size_t call_sites(const Identifier &callee) const;
+
+    // True if the function can reach itself, either directly or through its SCC
+    [[nodiscard]] bool is_recursive(const Identifier &function) const;
+
+    [[nodiscard]] bool same_component(const Identifier &a, const Identifier &b) const;
+
+    // Strongly connected components, callees before callers
+    [[nodiscard]] const std::vector<std::vector<Identifier>> &sccs() const { return components; }
+
+    // nullptr for builtins and unknown names
+    [[nodiscard]] AST::FunctionNode *function(const Identifier &name) const;
+
+private:
+    void strong_connect(const Identifier &, std::unordered_map<Identifier, std::pair<std::size_t, std::size_t>> &,
+                        std::vector<Identifier> &, std::size_t &);
+};
+
+#endif //COMPILER_CALLGRAPH_H
@@ -0,0 +1,250 @@
+#include "CompileCache.h"
+#include "Lexer.h"
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <set>
+#include <random>
+#include <sstream>
+#include <unordered_map>
+
+namespace {
+    // Bump whenever the generated code changes for the same input, so stale entries are never hit
+    constexpr std::uint64_t format_version = 3;
+
+    // FNV-1a
+    struct Hasher {
+        std::uint64_t hash = 14695981039346656037ull;
+
+        void add(const void *data, std::size_t size) {
+            const auto *bytes = static_cast<const unsigned char *>(data);
+            for(std::size_t i = 0; i < size; ++i) {
+                hash ^= bytes[i];
+                hash *= 1099511628211ull;
+            }
+        }
+
+        void add(std::uint64_t value) { add(&value, sizeof(value)); }
+
+        void add(const std::string &value) {
+            add(value.size());
+            add(value.data(), value.size());
+        }
+
+        void add(const Token &token) {
+            add(token.index());
+            std::visit([&](const auto &value) {
+                using T = std::decay_t<decltype(value)>;
+                if constexpr(std::is_same_v<T, Identifier>)
+                    add(value);
+                else if constexpr(std::is_same_v<T, IntegerLiteral>)
+                    add(value);
+                else if constexpr(!std::is_same_v<T, EndToken>)
+                    add(static_cast<std::uint64_t>(value));
+            }, token);
+        }
+    };
+
+    struct ScannedFunction {
+        Identifier name;
+        std::uint64_t local;
+        // Callee -> call sites in this function, ordered so the hash doesn't depend on the source order
+        std::map<Identifier, std::size_t> calls;
+        // Every identifier used, since a variable may not be named like a function declared before it
+        std::set<Identifier> identifiers;
+    };
+
+    std::string to_hex(std::uint64_t value) {
+        std::ostringstream out;
+        out << std::hex << value;
+        return out.str();
+    }
+}
+
+CompileCache::CompileCache(std::filesystem::path directory) : directory(std::move(directory)) {
+    std::filesystem::create_directories(this->directory);
+}
+
+std::optional<std::vector<CompileCache::FunctionInfo>> CompileCache::scan(const std::string &source,
+                                                                          std::uint64_t options) {
+    std::vector<Token> tokens;
+    try {
+        Lexer lexer(std::istringstream{source});
+        for(auto token = lexer.getNextToken(); !std::holds_alternative<EndToken>(token); token = lexer.getNextToken())
+            tokens.emplace_back(std::move(token));
+    } catch(const std::exception &) {
+        return std::nullopt;
+    }
+
+    // Split the tokens into functions: [memo] fn name ( parameters ) { body }
+    std::vector<ScannedFunction> functions;
+    std::unordered_map<Identifier, std::size_t> index;
+    std::unordered_map<Identifier, std::size_t> sites;
+    for(std::size_t i = 0; i < tokens.size();) {
+        const auto start = i;
+        if(tokens[i] == Token(Keyword::Memo))
+            ++i;
+        if(i + 2 >= tokens.size() || tokens[i] != Token(Keyword::Fn) || !std::holds_alternative<Identifier>(tokens[i + 1]))
+            return std::nullopt;
+        ScannedFunction function{std::get<Identifier>(tokens[i + 1]), 0, {}, {}};
+        if(index.contains(function.name))
+            return std::nullopt;
+        i += 2;
+
+        std::size_t depth = 0;
+        bool body = false;
+        for(; i < tokens.size(); ++i) {
+            if(tokens[i] == Token(Punctuation::OpenBrace)) {
+                ++depth;
+                body = true;
+            } else if(tokens[i] == Token(Punctuation::CloseBrace) && depth-- == 1) {
+                ++i;
+                break;
+            } else if(std::holds_alternative<Identifier>(tokens[i])) {
+                const auto &identifier = std::get<Identifier>(tokens[i]);
+                function.identifiers.insert(identifier);
+                if(i + 1 < tokens.size() && tokens[i + 1] == Token(Punctuation::OpenParen)) {
+                    ++function.calls[identifier];
+                    ++sites[identifier];
+                }
+            }
+        }
+        if(!body || depth != 0)
+            return std::nullopt;
+
+        Hasher local;
+        for(auto j = start; j < i; ++j)
+            local.add(tokens[j]);
+        function.local = local.hash;
+        index[function.name] = functions.size();
+        functions.push_back(std::move(function));
+    }
+    if(!index.contains("main"))
+        return std::nullopt;
+
+    // What this function's passes see of its callees, apart from their bodies
+    for(std::size_t f = 0; f < functions.size(); ++f) {
+        Hasher hasher;
+        hasher.add(functions[f].local);
+        for(const auto &[callee, count] : functions[f].calls) {
+            hasher.add(callee);
+            hasher.add(sites[callee]);
+        }
+        for(const auto &identifier : functions[f].identifiers) {
+            auto it = index.find(identifier);
+            // Whether it names a function declared before this one, since the parser only knows those
+            hasher.add(identifier);
+            hasher.add(it == index.end() ? 0 : it->second <= f ? 1 : 2);
+        }
+        functions[f].local = hasher.hash;
+    }
+
+    // Tarjan's SCCs over the call graph, hashing every component after the components it calls
+    std::vector<std::uint64_t> component_hash(functions.size());
+    std::vector<std::size_t> order(functions.size(), 0), low(functions.size(), 0), component(functions.size(), 0);
+    std::vector<std::size_t> stack;
+    std::vector<bool> on_stack(functions.size(), false);
+    std::size_t counter = 0, components = 0;
+    std::vector<std::uint64_t> hashes;
+    std::function<void(std::size_t)> connect = [&](std::size_t f) {
+        order[f] = low[f] = ++counter;
+        stack.push_back(f);
+        on_stack[f] = true;
+        for(const auto &[callee, count] : functions[f].calls) {
+            auto it = index.find(callee);
+            if(it == index.end())
+                continue;
+            auto g = it->second;
+            if(!order[g]) {
+                connect(g);
+                low[f] = std::min(low[f], low[g]);
+            } else if(on_stack[g]) {
+                low[f] = std::min(low[f], order[g]);
+            }
+        }
+        if(low[f] != order[f])
+            return;
+
+        std::vector<std::size_t> members;
+        std::size_t member;
+        do {
+            member = stack.back();
+            stack.pop_back();
+            on_stack[member] = false;
+            component[member] = components;
+            members.push_back(member);
+        } while(member != f);
+
+        std::vector<std::uint64_t> parts;
+        for(auto m : members) {
+            parts.push_back(functions[m].local);
+            for(const auto &[callee, count] : functions[m].calls) {
+                auto it = index.find(callee);
+                if(it != index.end() && component[it->second] != components)
+                    parts.push_back(hashes[component[it->second]]);
+            }
+        }
+        std::sort(parts.begin(), parts.end());
+        Hasher hasher;
+        for(auto part : parts)
+            hasher.add(part);
+        hashes.push_back(hasher.hash);
+        ++components;
+    };
+    for(std::size_t f = 0; f < functions.size(); ++f) {
+        if(!order[f])
+            connect(f);
+    }
+
+    std::vector<FunctionInfo> ret;
+    ret.reserve(functions.size());
+    for(std::size_t f = 0; f < functions.size(); ++f) {
+        Hasher hasher;
+        hasher.add(format_version);
+        hasher.add(options);
+        hasher.add(functions[f].local);
+        hasher.add(hashes[component[f]]);
+        ret.push_back({functions[f].name, to_hex(hasher.hash), sites[functions[f].name]});
+    }
+    return ret;
+}
+
+std::optional<CompileCache::Entry> CompileCache::load(const std::string &key) {
+    std::ifstream in(directory / key, std::ios::binary);
+    Entry entry;
+    std::string magic;
+    std::size_t calls = 0;
+    if(!(in >> magic >> entry.memo_cache >> entry.select >> entry.arrays >> calls)
+       || magic != "arjc" + std::to_string(format_version))
+        return std::nullopt;
+    for(std::size_t i = 0; i < calls; ++i) {
+        std::pair<Identifier, std::size_t> call;
+        if(!(in >> call.first >> call.second))
+            return std::nullopt;
+        entry.calls.push_back(std::move(call));
+    }
+    in.ignore(); // Newline before the code
+    entry.code.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    return entry;
+}
+
+void CompileCache::store(const std::string &key, const Entry &entry) {
+    // Written to a temporary file and renamed, so concurrent compiles never see a partial entry
+    thread_local std::mt19937_64 random{std::random_device{}()};
+    auto temporary = directory / (key + '.' + to_hex(random()) + ".tmp");
+    {
+        std::ofstream out(temporary, std::ios::binary);
+        out << "arjc" << format_version << ' ' << entry.memo_cache << ' ' << entry.select << ' ' << entry.arrays
+            << ' ' << entry.calls.size() << '\n';
+        for(const auto &[callee, count] : entry.calls)
+            out << callee << ' ' << count << '\n';
+        out << entry.code;
+        if(!out)
+            return;
+    }
+    std::error_code error;
+    std::filesystem::rename(temporary, directory / key, error);
+    if(error)
+        std::filesystem::remove(temporary, error);
+}
@@ -0,0 +1,54 @@
+#pragma once
+#ifndef COMPILER_COMPILECACHE_H
+#define COMPILER_COMPILECACHE_H
+
+#include "Token.h"
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+// On-disk cache of the generated code for every top-level function.
+// The key of a function is a hash of its own tokens, the compiler options, and for every function it calls: the
+// name, the number of call sites in the program, whether it is declared before it, and the keys of everything it
+// calls in turn. That is everything the passes look at, so a hit reproduces exactly what a full compile would emit.
+class CompileCache {
+public:
+    // A top-level function found by scanning the tokens, without parsing
+    struct FunctionInfo {
+        Identifier name;
+        std::string key;
+        // Call sites in the whole program, before optimization
+        std::size_t call_sites;
+    };
+
+    struct Entry {
+        std::string code;
+        // Runtime support the code needs in the prelude
+        bool memo_cache = false;
+        bool select = false;
+        bool arrays = false;
+        // Calls left in the code after optimization, used to drop functions that were inlined everywhere
+        std::vector<std::pair<Identifier, std::size_t>> calls;
+    };
+
+private:
+    std::filesystem::path directory;
+
+public:
+    explicit CompileCache(std::filesystem::path directory);
+
+    // nullopt if the source isn't a well formed list of functions with a main, so the caller falls back
+    // to a full compile which reports the error
+    [[nodiscard]] static std::optional<std::vector<FunctionInfo>> scan(const std::string &source,
+                                                                       std::uint64_t options);
+
+    // nullopt on a miss
+    [[nodiscard]] std::optional<Entry> load(const std::string &key);
+
+    void store(const std::string &key, const Entry &entry);
+};
+
+#endif //COMPILER_COMPILECACHE_H
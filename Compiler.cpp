@@ -0,0 +1,275 @@
+#include "Compiler.h"
+#include "CompileCache.h"
+#include "Inliner.h"
+#include "Bounds.h"
+#include "Loops.h"
+#include "TailCalls.h"
+#include "Effects.h"
+#include "Select.h"
+#include "Profile.h"
+#include "Stats.h"
+#include "Module.h"
+#include <algorithm>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+
+bool CompileOptions::parse(std::string_view arg) {
+    if (arg == "--no-inline")
+        inline_functions = false;
+    else if (arg == "--inline-report")
+        inline_report = true;
+    else if (arg == "--no-bounds-elim")
+        bounds = false;
+    else if (arg == "--bounds-report")
+        bounds_report = true;
+    else if (arg == "--no-loop-opts")
+        loops = false;
+    else if (arg == "--loop-report")
+        loop_report = true;
+    else if (arg == "--no-tail-calls")
+        tail_calls = false;
+    else if (arg == "--tail-call-report")
+        tail_call_report = true;
+    else if (arg == "--no-auto-memoize")
+        memoize.automatic = false;
+    else if (arg == "--memoize-report")
+        memoize_report = true;
+    else if (arg == "--no-branchless")
+        branchless = false;
+    else if (arg == "--select-report")
+        select_report = true;
+    else if (arg.starts_with("--cache="))
+        cache_directory = arg.substr(std::string_view("--cache=").size());
+    else if (arg == "--pipelined-lexer")
+        pipelined_lexer = true;
+    else if (arg == "--cache-stats")
+        cache_stats = true;
+    else if (arg.starts_with("--emit-module="))
+        emit_module = arg.substr(std::string_view("--emit-module=").size());
+    else if (arg == "--from-module")
+        from_module = true;
+    else if (arg.starts_with("--instrument="))
+        instrument = arg.substr(std::string_view("--instrument=").size());
+    else if (arg.starts_with("--profile-use="))
+        profile_use = arg.substr(std::string_view("--profile-use=").size());
+    else if (arg == "--profile-report")
+        profile_report = true;
+    else
+        return false;
+    return true;
+}
+
+std::uint64_t CompileOptions::fingerprint() const {
+    std::uint64_t hash = 0;
+    for (std::uint64_t value : {std::uint64_t(inline_functions), std::uint64_t(bounds), std::uint64_t(loops),
+                                std::uint64_t(tail_calls), std::uint64_t(memoize.automatic),
+                                std::uint64_t(memoize.max_parameters), std::uint64_t(branchless)}) {
+        hash = (hash ^ value) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+Compiler::Compiler(CompileOptions options) : options(std::move(options)) {
+    if (!this->options.cache_directory.empty())
+        cache = std::make_shared<CompileCache>(this->options.cache_directory);
+}
+
+void Compiler::compile(const std::string &source, std::ostream &out, std::ostream &diagnostics) {
+    // The cache keys don't cover the profile
+    if (cache && options.instrument.empty() && options.profile_use.empty()) {
+        compile_cached(source, *cache, out, diagnostics);
+        return;
+    }
+    Parser parser(std::istringstream{source});
+    start_lexer(parser, source);
+    parser.parse_program();
+    optimize(parser.get_functions(), diagnostics, true);
+    if (!options.instrument.empty())
+        Profile::transpile_runtime(out, parser.get_functions(), options.instrument);
+    parser.transpile(out);
+}
+
+void Compiler::compile(const Module &module, std::ostream &out, std::ostream &diagnostics) {
+    auto functions = module.to_ast();
+    optimize(functions, diagnostics, true);
+    if (!options.instrument.empty())
+        Profile::transpile_runtime(out, functions, options.instrument);
+    Parser::transpile_functions(out, functions);
+}
+
+void Compiler::compile_module(const std::string &source, const Parser::ImportResolver &resolver, std::ostream &out,
+                              std::ostream &diagnostics) {
+    // Every module would define the counters
+    if (!options.instrument.empty())
+        throw std::runtime_error("--instrument only works on whole programs");
+    Parser parser(std::istringstream{source});
+    start_lexer(parser, source);
+    parser.set_import_resolver(resolver).parse_program();
+    // Other modules may call any function, so none of them are dead
+    optimize(parser.get_functions(), diagnostics, false, true);
+    parser.transpile(out);
+}
+
+void Compiler::emit_module(const std::string &source, std::ostream &out) {
+    Parser parser(std::istringstream{source});
+    parser.parse_program();
+    write_module(parser.get_functions(), out);
+}
+
+void Compiler::optimize(std::vector<AST::FunctionNodePtr> &functions, std::ostream &diagnostics,
+                        bool remove_dead_functions, bool export_all) {
+    // Before anything changes the ifs, so they get the numbers they had when the profile was written
+    Profile::number(functions);
+    Profile profile;
+    if (!options.profile_use.empty()) {
+        profile.load(options.profile_use).apply(functions);
+        if (options.profile_report)
+            profile.print_report(diagnostics);
+    }
+    if (options.inline_functions) {
+        Inliner::Options inline_options;
+        inline_options.remove_dead_functions = remove_dead_functions;
+        inline_options.hot_functions = profile.hot_functions();
+        STATS_PHASE(Inline);
+        Inliner inliner(inline_options);
+        inliner.run(functions);
+        if (options.inline_report)
+            inliner.print_report(diagnostics);
+    }
+    if (options.bounds) {
+        STATS_PHASE(Bounds);
+        BoundsCheckElimination elimination;
+        elimination.run(functions);
+        if (options.bounds_report)
+            elimination.print_report(diagnostics);
+    }
+    if (options.loops) {
+        STATS_PHASE(Loops);
+        LoopOptimizer loop_optimizer;
+        loop_optimizer.run(functions);
+        if (options.loop_report)
+            loop_optimizer.print_report(diagnostics);
+    }
+    if (options.tail_calls) {
+        STATS_PHASE(TailCalls);
+        TailCallOptimizer optimizer;
+        optimizer.run(functions);
+        if (options.tail_call_report)
+            optimizer.print_report(diagnostics);
+    }
+    {
+        // Always runs, since it also checks that functions marked memo are pure
+        STATS_PHASE(Memoize);
+        Memoizer memoizer(options.memoize);
+        memoizer.run(functions);
+        if (options.memoize_report)
+            memoizer.print_report(diagnostics);
+    }
+    if (options.branchless) {
+        STATS_PHASE(Select);
+        SelectLowering lowering;
+        lowering.run(functions);
+        if (options.select_report)
+            lowering.print_report(diagnostics);
+    }
+    {
+        STATS_PHASE(Effects);
+        EffectAnalysis(functions).annotate(functions, export_all);
+    }
+    if (!options.instrument.empty())
+        Profile::instrument(functions);
+}
+
+void Compiler::start_lexer(Parser &parser, const std::string &source) const {
+    // On a single core the two threads would only take turns
+    if (options.pipelined_lexer && source.size() >= options.pipelined_lexer_bytes
+        && std::thread::hardware_concurrency() > 1)
+        parser.pipeline_lexer();
+}
+
+// Functions that hit the cache are neither optimized nor transpiled again. If every function hits, the source
+// isn't even parsed. On a miss the whole program is parsed and optimized, since the inliner needs the callees,
+// but only the missing functions are transpiled.
+void Compiler::compile_cached(const std::string &source, CompileCache &cache, std::ostream &out,
+                              std::ostream &diagnostics) {
+    auto scanned = CompileCache::scan(source, options.fingerprint());
+    if (!scanned) {
+        // Not a well formed program, compile it normally so the error gets reported
+        Parser parser(std::istringstream{source});
+        start_lexer(parser, source);
+        parser.parse_program();
+        optimize(parser.get_functions(), diagnostics, true);
+        parser.transpile(out);
+        return;
+    }
+
+    std::vector<std::optional<CompileCache::Entry>> entries;
+    entries.reserve(scanned->size());
+    for (const auto &function : *scanned)
+        entries.emplace_back(cache.load(function.key));
+    // Counted here rather than from the cache's totals, which other compiles may be adding to
+    const std::size_t misses = std::ranges::count_if(entries, [](const auto &entry) { return !entry; });
+    const auto hits = entries.size() - misses;
+
+    if (misses) {
+        Parser parser(std::istringstream{source});
+        start_lexer(parser, source);
+        parser.parse_program();
+        // Dead functions are dropped below instead, a function that is dead now may not be on the next compile
+        optimize(parser.get_functions(), diagnostics, false);
+
+        std::unordered_map<Identifier, AST::FunctionNode *> nodes;
+        for (auto &function : parser.get_functions())
+            nodes[function->name] = function.get();
+
+        for (std::size_t i = 0; i < entries.size(); ++i) {
+            if (entries[i])
+                continue;
+            auto &function = *nodes.at((*scanned)[i].name);
+            CompileCache::Entry entry;
+            std::ostringstream code;
+            function.transpile(code);
+            entry.code = std::move(code).str();
+            entry.memo_cache = function.memoize;
+            entry.select = AST::contains_select(function);
+            entry.arrays = AST::contains_array(function);
+            std::map<Identifier, std::size_t> calls;
+            AST::for_each(function, [&](AST::Node &node) {
+                if (auto *call = dynamic_cast<AST::FunctionCall *>(&node))
+                    ++calls[call->identifier];
+            });
+            entry.calls.assign(calls.begin(), calls.end());
+            cache.store((*scanned)[i].key, entry);
+            entries[i] = std::move(entry);
+        }
+    }
+
+    // A function is dropped if it had call sites and all of them were inlined, just like the inliner does
+    std::unordered_map<Identifier, std::size_t> remaining;
+    for (const auto &entry : entries) {
+        for (const auto &[callee, count] : entry->calls)
+            remaining[callee] += count;
+    }
+    std::vector<bool> keep(entries.size());
+    bool memo_cache = false, select = false, arrays = false;
+    for (std::size_t i = 0; i < entries.size(); ++i) {
+        const auto &function = (*scanned)[i];
+        keep[i] = function.name == "main" || function.call_sites == 0 || remaining[function.name] != 0;
+        memo_cache = memo_cache || (keep[i] && entries[i]->memo_cache);
+        select = select || (keep[i] && entries[i]->select);
+        arrays = arrays || (keep[i] && entries[i]->arrays);
+    }
+
+    Parser::transpile_prelude(out, memo_cache, select, arrays);
+    for (std::size_t i = 0; i < entries.size(); ++i) {
+        if (keep[i])
+            out << entries[i]->code;
+    }
+
+    if (options.cache_stats) {
+        diagnostics << "cache: " << hits << " hits, " << misses << " misses\n";
+    }
+}
@@ -0,0 +1,86 @@
+#pragma once
+#ifndef COMPILER_COMPILER_H
+#define COMPILER_COMPILER_H
+
+#include "Parser.h"
+#include "Memoize.h"
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+class CompileCache;
+class Module;
+
+struct CompileOptions {
+    bool inline_functions = true;
+    bool inline_report = false;
+    bool bounds = true;
+    bool bounds_report = false;
+    bool loops = true;
+    bool loop_report = false;
+    bool tail_calls = true;
+    bool tail_call_report = false;
+    Memoizer::Options memoize;
+    bool memoize_report = false;
+    bool branchless = true;
+    bool select_report = false;
+    // Lex on a separate thread while parsing sources of at least pipelined_lexer_bytes
+    bool pipelined_lexer = false;
+    std::size_t pipelined_lexer_bytes = 64 * 1024;
+    // Empty disables the incremental cache
+    std::string cache_directory;
+    bool cache_stats = false;
+    // Write the parsed program as a binary module to this path instead of transpiling it
+    std::string emit_module;
+    // The input is a module written with --emit-module rather than source
+    bool from_module = false;
+    // The generated program writes a profile to this path when it exits, empty disables it
+    std::string instrument;
+    // Optimize with a profile written by an instrumented program, empty disables it
+    std::string profile_use;
+    bool profile_report = false;
+
+    // Returns false if the argument isn't a compiler option
+    bool parse(std::string_view arg);
+
+    // Hash of every option that changes the generated code
+    [[nodiscard]] std::uint64_t fingerprint() const;
+};
+
+// Runs the whole pipeline: parsing, the optimization passes and transpilation.
+// Throws SyntaxErrorException if the program is malformed.
+class Compiler {
+    CompileOptions options;
+    // Shared so it stays warm across compiles
+    std::shared_ptr<CompileCache> cache;
+
+public:
+    explicit Compiler(CompileOptions options);
+
+    // Reports are written to diagnostics
+    void compile(const std::string &source, std::ostream &out, std::ostream &diagnostics);
+
+    // Starts from a pre-parsed module instead of source
+    void compile(const Module &module, std::ostream &out, std::ostream &diagnostics);
+
+    // Compiles one module of a program built with separate compilation. Imports are resolved with the resolver,
+    // main is optional and every function is exported. Bypasses the cache, since its keys don't cover imports.
+    void compile_module(const std::string &source, const Parser::ImportResolver &resolver, std::ostream &out,
+                        std::ostream &diagnostics);
+
+    // Parses the source and writes it as a binary module
+    static void emit_module(const std::string &source, std::ostream &out);
+
+private:
+    void optimize(std::vector<AST::FunctionNodePtr> &, std::ostream &diagnostics, bool remove_dead_functions,
+                  bool export_all = false);
+
+    // Starts the lexer thread if the source is large enough to be worth it
+    void start_lexer(Parser &, const std::string &source) const;
+
+    void compile_cached(const std::string &source, CompileCache &, std::ostream &out, std::ostream &diagnostics);
+};
+
+#endif //COMPILER_COMPILER_H
@@ -0,0 +1,297 @@
+#include "Daemon.h"
+#include "Parallel.h"
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+    constexpr std::string_view protocol_magic = "arjd1";
+
+    std::runtime_error socket_error(const std::string &what) {
+        return std::runtime_error(what + ": " + std::strerror(errno));
+    }
+
+    sockaddr_un unix_address(const std::filesystem::path &socket) {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        const auto &path = socket.native();
+        if(path.size() >= sizeof(address.sun_path))
+            throw std::runtime_error(path + ": socket path is too long");
+        std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+        return address;
+    }
+
+    // Owns a connected socket and reads from it through a buffer
+    class SocketStream {
+        int fd;
+        std::string buffer;
+        std::size_t position = 0;
+
+        bool fill() {
+            char chunk[65536];
+            ssize_t count;
+            do {
+                count = ::recv(fd, chunk, sizeof chunk, 0);
+            } while(count < 0 && errno == EINTR);
+            if(count <= 0)
+                return false;
+            buffer.erase(0, position);
+            position = 0;
+            buffer.append(chunk, static_cast<std::size_t>(count));
+            return true;
+        }
+
+    public:
+        explicit SocketStream(int fd) : fd(fd) {}
+
+        SocketStream(const SocketStream &) = delete;
+
+        SocketStream &operator=(const SocketStream &) = delete;
+
+        ~SocketStream() { ::close(fd); }
+
+        std::string line() {
+            std::size_t end;
+            while((end = buffer.find('\n', position)) == std::string::npos) {
+                if(!fill())
+                    throw std::runtime_error("connection closed in the middle of a message");
+            }
+            auto result = buffer.substr(position, end - position);
+            position = end + 1;
+            return result;
+        }
+
+        std::string bytes(std::size_t count) {
+            while(buffer.size() - position < count) {
+                if(!fill())
+                    throw std::runtime_error("connection closed in the middle of a message");
+            }
+            auto result = buffer.substr(position, count);
+            position += count;
+            return result;
+        }
+
+        void write(std::string_view data) {
+            while(!data.empty()) {
+                // No SIGPIPE if the other end is gone, that's reported as an error instead
+                auto count = ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+                if(count < 0 && errno == EINTR)
+                    continue;
+                if(count < 0)
+                    throw socket_error("send");
+                data.remove_prefix(static_cast<std::size_t>(count));
+            }
+        }
+    };
+
+    // The header line after the magic, as numbers
+    std::vector<std::size_t> header(const std::string &line, std::size_t fields) {
+        std::istringstream in(line);
+        std::string magic;
+        std::vector<std::size_t> values(fields);
+        in >> magic;
+        for(auto &value : values)
+            in >> value;
+        if(!in || magic != protocol_magic)
+            throw std::runtime_error("malformed message header");
+        return values;
+    }
+
+    int connect_to(const std::filesystem::path &socket) {
+        auto address = unix_address(socket);
+        int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if(fd < 0)
+            throw socket_error("socket");
+        if(::connect(fd, reinterpret_cast<const sockaddr *>(&address), sizeof address) < 0) {
+            auto error = socket_error(socket.string());
+            ::close(fd);
+            throw error;
+        }
+        return fd;
+    }
+
+    std::string encode(const Daemon::Request &request) {
+        std::string message = std::string(protocol_magic) + ' ' + std::to_string(request.arguments.size()) + ' '
+                              + std::to_string(request.source.size()) + '\n';
+        for(const auto &argument : request.arguments)
+            message += argument + '\n';
+        return message + request.source;
+    }
+
+    std::string encode(const Daemon::Response &response) {
+        return std::string(protocol_magic) + ' ' + std::to_string(response.exit_code) + ' '
+               + std::to_string(response.output.size()) + ' ' + std::to_string(response.diagnostics.size()) + '\n'
+               + response.output + response.diagnostics;
+    }
+
+    const std::string stop_argument = "--stop";
+}
+
+Daemon::Response Daemon::send(const std::filesystem::path &socket, Request request) {
+    // The daemon may not run in the same directory
+    for(auto &argument : request.arguments) {
+        for(std::string_view option : {"--instrument=", "--profile-use="}) {
+            if(argument.starts_with(option) && argument.size() > option.size())
+                argument = std::string(option) + std::filesystem::absolute(argument.substr(option.size())).string();
+        }
+    }
+    SocketStream stream(connect_to(socket));
+    stream.write(encode(request));
+    auto sizes = header(stream.line(), 3);
+    Response response;
+    response.exit_code = static_cast<int>(sizes[0]);
+    response.output = stream.bytes(sizes[1]);
+    response.diagnostics = stream.bytes(sizes[2]);
+    return response;
+}
+
+void Daemon::stop(const std::filesystem::path &socket) {
+    send(socket, {{stop_argument}, {}});
+}
+
+CompileServer::CompileServer(Options options) : options(std::move(options)) {
+    auto address = unix_address(this->options.socket);
+    listener = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(listener < 0)
+        throw socket_error("socket");
+    // Left behind by a server that didn't shut down cleanly
+    std::error_code error;
+    std::filesystem::remove(this->options.socket, error);
+    if(::bind(listener, reinterpret_cast<const sockaddr *>(&address), sizeof address) < 0
+       || ::listen(listener, SOMAXCONN) < 0) {
+        auto failure = socket_error(this->options.socket.string());
+        ::close(listener);
+        throw failure;
+    }
+}
+
+CompileServer::~CompileServer() {
+    ::close(listener);
+    std::error_code error;
+    std::filesystem::remove(options.socket, error);
+}
+
+void CompileServer::run(std::ostream &log) {
+    const auto jobs = options.jobs ? options.jobs : std::max(1u, std::thread::hardware_concurrency());
+    std::mutex log_mutex;
+    parallel_for(jobs, jobs, [&](std::size_t) {
+        while(!stopping) {
+            int fd = ::accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+            if(fd < 0) {
+                if(errno == EINTR || errno == ECONNABORTED)
+                    continue;
+                // The listener was shut down by a stop request
+                if(!stopping) {
+                    std::scoped_lock lock(log_mutex);
+                    log << "accept: " << std::strerror(errno) << '\n';
+                }
+                return;
+            }
+            try {
+                SocketStream stream(fd);
+                auto sizes = header(stream.line(), 2);
+                Daemon::Request request;
+                for(std::size_t i = 0; i < sizes[0]; ++i)
+                    request.arguments.push_back(stream.line());
+                request.source = stream.bytes(sizes[1]);
+                if(request.arguments == std::vector{stop_argument}) {
+                    stream.write(encode(Daemon::Response{}));
+                    stopping = true;
+                    // Wakes up the threads waiting in accept
+                    ::shutdown(listener, SHUT_RDWR);
+                    return;
+                }
+                stream.write(encode(handle(request)));
+            } catch(const std::exception &e) {
+                std::scoped_lock lock(log_mutex);
+                log << "connection: " << e.what() << '\n';
+            }
+        }
+    });
+}
+
+Daemon::Response CompileServer::handle(const Daemon::Request &request) {
+    Daemon::Response response;
+    CompileOptions compile_options;
+    std::string key, path;
+    for(const auto &argument : request.arguments) {
+        if(compile_options.parse(argument)) {
+            key += argument + '\n';
+        } else if(argument.starts_with("--") || !path.empty()) {
+            response.exit_code = 2;
+            response.diagnostics = argument + ": not a compiler option\n";
+            return response;
+        } else {
+            path = argument;
+        }
+    }
+    if(!compile_options.emit_module.empty() || compile_options.from_module) {
+        response.exit_code = 2;
+        response.diagnostics = "modules can't be used through the daemon\n";
+        return response;
+    }
+
+    std::string source = request.source;
+    if(source.empty() && !path.empty()) {
+        std::ifstream in(path);
+        if(!in) {
+            response.exit_code = 1;
+            response.diagnostics = path + ": cannot read file\n";
+            return response;
+        }
+        std::stringstream contents;
+        contents << in.rdbuf();
+        source = std::move(contents).str();
+    }
+
+    // A file compiled from a path could change, so only responses to sent sources are reused. The same goes for
+    // the profile, and an instrumented compile has to run to write its output.
+    const bool reusable = options.cached_responses && !request.source.empty() && compile_options.instrument.empty()
+                          && compile_options.profile_use.empty();
+    const auto response_key = key + '\0' + path + '\0' + source;
+    if(reusable) {
+        std::scoped_lock lock(responses_mutex);
+        if(auto it = responses.find(response_key); it != responses.end())
+            return it->second;
+    }
+
+    std::ostringstream out, diagnostics;
+    try {
+        compiler(key, compile_options).compile(source, out, diagnostics);
+        response.output = std::move(out).str();
+    } catch(const SyntaxErrorException &e) {
+        // Where and how a direct compile reports it
+        response.output = std::string(e.what()) + ". At line " + std::to_string(e.getLine()) + ", pos. "
+                          + std::to_string(e.getPosition()) + ".\n";
+    } catch(const std::exception &e) {
+        diagnostics << e.what() << '\n';
+        response.exit_code = 1;
+    }
+    response.diagnostics = std::move(diagnostics).str();
+
+    if(reusable) {
+        std::scoped_lock lock(responses_mutex);
+        if(responses.emplace(response_key, response).second) {
+            response_order.push_back(response_key);
+            if(response_order.size() > options.cached_responses) {
+                responses.erase(response_order.front());
+                response_order.pop_front();
+            }
+        }
+    }
+    return response;
+}
+
+Compiler &CompileServer::compiler(const std::string &key, const CompileOptions &compile_options) {
+    std::scoped_lock lock(compilers_mutex);
+    auto &compiler = compilers[key];
+    if(!compiler)
+        compiler = std::make_unique<Compiler>(compile_options);
+    return *compiler;
+}
@@ -0,0 +1,88 @@
+#pragma once
+#ifndef COMPILER_DAEMON_H
+#define COMPILER_DAEMON_H
+
+#include "Compiler.h"
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// The protocol spoken over the socket, one request and one response per connection.
+// A request is a header line "arjd1 <arguments> <source bytes>\n", then one argument per line, then the source.
+// The arguments are compiler options and, if the source is empty, the path of the file to compile.
+// A response is "arjd1 <exit code> <output bytes> <diagnostics bytes>\n" followed by the output and diagnostics.
+namespace Daemon {
+    struct Request {
+        std::vector<std::string> arguments;
+        std::string source;
+    };
+
+    struct Response {
+        int exit_code = 0;
+        std::string output;
+        std::string diagnostics;
+    };
+
+    // Sends the request to the server listening on socket. Throws std::runtime_error if it can't be reached.
+    // Relative profile paths in the arguments are made absolute first.
+    Response send(const std::filesystem::path &socket, Request);
+
+    // Asks the server to stop once the requests it is handling are done
+    void stop(const std::filesystem::path &socket);
+}
+
+// Compiles requests from clients on a Unix domain socket, so the process and everything it has warmed up
+// outlives a single compile. Compilers are kept per set of options, so their on-disk caches stay open, and
+// the responses to the most recent distinct requests are kept in memory and sent again without compiling.
+// Up to jobs clients are served at once, each by a thread that accepts connections on its own.
+class CompileServer {
+public:
+    struct Options {
+        std::filesystem::path socket;
+        // 0 uses one thread per core
+        std::size_t jobs = 0;
+        // Responses kept for repeated requests, 0 disables reusing them
+        std::size_t cached_responses = 256;
+    };
+
+private:
+    Options options;
+    int listener = -1;
+    std::atomic<bool> stopping = false;
+
+    std::mutex compilers_mutex;
+    std::unordered_map<std::string, std::unique_ptr<Compiler>> compilers;
+
+    std::mutex responses_mutex;
+    std::unordered_map<std::string, Daemon::Response> responses;
+    // Oldest first, evicted when there are more than cached_responses
+    std::deque<std::string> response_order;
+
+public:
+    // Binds the socket, replacing a stale one. Throws std::runtime_error if that fails.
+    explicit CompileServer(Options options);
+
+    CompileServer(const CompileServer &) = delete;
+
+    CompileServer &operator=(const CompileServer &) = delete;
+
+    ~CompileServer();
+
+    // Serves clients until one of them asks it to stop. Failed connections are reported to log.
+    void run(std::ostream &log);
+
+    // Compiles a request the way a client connection would have it compiled
+    Daemon::Response handle(const Daemon::Request &);
+
+private:
+    Compiler &compiler(const std::string &key, const CompileOptions &);
+};
+
+#endif //COMPILER_DAEMON_H
@@ -0,0 +1,56 @@
+#include "Effects.h"
+#include <algorithm>
+
+EffectAnalysis::EffectAnalysis(const std::vector<AST::FunctionNodePtr> &functions) {
+    for(const auto &function : functions) {
+        effects[function->name] = function->memoize ? Effect::Pure : Effect::Const;
+        if(function->memoize)
+            reasons[function->name] = "memoized";
+    }
+
+    bool changed = true;
+    while(changed) {
+        changed = false;
+        for(const auto &function : functions) {
+            auto &current = effects[function->name];
+            if(current == Effect::Impure)
+                continue;
+            AST::for_each(*function, [&](AST::Node &node) {
+                // The compiler could drop an unused call, and with it the abort
+                auto *index = dynamic_cast<AST::IndexNode *>(&node);
+                if(index && index->checked && current != Effect::Impure) {
+                    current = Effect::Impure;
+                    reasons[function->name] = "may access " + index->array + " out of bounds";
+                    changed = true;
+                    return;
+                }
+                auto *call = dynamic_cast<AST::FunctionCall *>(&node);
+                if(!call)
+                    return;
+                auto callee = effect(call->identifier);
+                if(callee <= current)
+                    return;
+                current = callee;
+                reasons[function->name] = "calls " + call->identifier;
+                changed = true;
+            });
+        }
+    }
+}
+
+Effect EffectAnalysis::effect(const Identifier &function) const {
+    auto it = effects.find(function);
+    return it == effects.end() ? Effect::Impure : it->second;
+}
+
+std::string EffectAnalysis::reason(const Identifier &function) const {
+    auto it = reasons.find(function);
+    return it == reasons.end() ? std::string{} : it->second;
+}
+
+void EffectAnalysis::annotate(std::vector<AST::FunctionNodePtr> &functions, bool export_all) const {
+    for(auto &function : functions) {
+        function->effect = effect(function->name);
+        function->internal = !export_all && function->name != "main";
+    }
+}
@@ -0,0 +1,34 @@
+#pragma once
+#ifndef COMPILER_EFFECTS_H
+#define COMPILER_EFFECTS_H
+
+#include "ASTNode.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Computes the effect of every function as a fixpoint over the call graph.
+// Functions start out const and are demoted until nothing changes, so recursion doesn't make a function impure.
+// An array access that is still checked may abort, so it makes its function impure.
+class EffectAnalysis {
+    std::unordered_map<Identifier, Effect> effects;
+    // Why a function is impure, e.g. "calls print"
+    std::unordered_map<Identifier, std::string> reasons;
+
+public:
+    explicit EffectAnalysis(const std::vector<AST::FunctionNodePtr> &functions);
+
+    // Builtins and unknown functions are impure
+    [[nodiscard]] Effect effect(const Identifier &function) const;
+
+    [[nodiscard]] bool is_pure(const Identifier &function) const { return effect(function) != Effect::Impure; }
+
+    // Empty for const functions
+    [[nodiscard]] std::string reason(const Identifier &function) const;
+
+    // Stores the effects on the functions for the transpiler. Everything except main is only called from within
+    // the generated file, so it is marked internal as well, unless the file is a module other modules link against.
+    void annotate(std::vector<AST::FunctionNodePtr> &functions, bool export_all = false) const;
+};
+
+#endif //COMPILER_EFFECTS_H
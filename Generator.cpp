@@ -0,0 +1,185 @@
+#include "Generator.h"
+#include <algorithm>
+
+ProgramGenerator::ProgramGenerator(Options options) : options(options), random(options.seed) {
+    // Lowercase letters followed by the index, so the names are distinct, vary in length and are never keywords.
+    // Functions are named with an uppercase F and can't collide with them.
+    const auto count = std::max<std::size_t>(options.identifiers, 3);
+    names.reserve(count);
+    for(std::size_t i = 0; i < count; ++i) {
+        std::string name;
+        for(auto length = 1 + pick(8); length; --length)
+            name += static_cast<char>('a' + pick(26));
+        names.push_back(name + std::to_string(i));
+    }
+}
+
+std::size_t ProgramGenerator::pick(std::size_t count) {
+    return std::uniform_int_distribution<std::size_t>(0, count - 1)(random);
+}
+
+bool ProgramGenerator::chance(double probability) {
+    return std::bernoulli_distribution(probability)(random);
+}
+
+std::string ProgramGenerator::function_name(std::size_t index) const {
+    return "F" + std::to_string(index);
+}
+
+bool ProgramGenerator::declared(std::size_t name) const {
+    return std::ranges::any_of(scopes, [&](const auto &scope) {
+        return std::ranges::find(scope, name) != scope.end();
+    });
+}
+
+std::size_t ProgramGenerator::visible_count() const {
+    std::size_t count = 0;
+    for(const auto &scope : scopes)
+        count += scope.size();
+    return count;
+}
+
+const std::string &ProgramGenerator::visible(std::size_t index) const {
+    for(const auto &scope : scopes) {
+        if(index < scope.size())
+            return names[scope[index]];
+        index -= scope.size();
+    }
+    return names.front();
+}
+
+std::string ProgramGenerator::generate() {
+    out.clear();
+    arities.clear();
+    const auto functions = std::max<std::size_t>(options.functions, 1);
+    for(std::size_t i = 0; options.bytes ? out.size() < options.bytes : i < functions; ++i)
+        function(i);
+
+    out += "fn main() {\n    print(" + function_name(arities.size() - 1) + "(";
+    for(std::size_t i = 0; i < arities.back(); ++i)
+        out += (i ? ", " : "") + std::to_string(1 + pick(9));
+    out += "));\n    return 0;\n}\n";
+    return std::move(out);
+}
+
+void ProgramGenerator::function(std::size_t index) {
+    const auto arity = 1 + pick(3);
+    scopes.assign(1, {});
+    out += "fn " + function_name(index) + "(";
+    while(scopes.front().size() < arity) {
+        auto name = pick(names.size());
+        if(declared(name))
+            continue;
+        out += (scopes.front().empty() ? "" : ", ") + names[name];
+        scopes.front().push_back(name);
+    }
+    out += ") {\n";
+    for(std::size_t i = 0; i < options.statements; ++i)
+        statement(0, 1);
+    out += "    return ";
+    expression(options.expression_depth);
+    out += ";\n}\n\n";
+    arities.push_back(arity);
+}
+
+void ProgramGenerator::statement(std::size_t nesting, std::size_t indent) {
+    out.append(indent * 4, ' ');
+    auto kind = pick(100);
+    if(kind < 35) {
+        // A name that isn't visible yet, or an assignment if they all are
+        for(std::size_t attempt = 0; attempt < 8; ++attempt) {
+            auto name = pick(names.size());
+            if(declared(name))
+                continue;
+            out += "let " + names[name] + " = ";
+            expression(options.expression_depth);
+            out += ";\n";
+            scopes.back().push_back(name);
+            return;
+        }
+        kind = 35;
+    }
+    if(kind < 60) {
+        out += visible(pick(visible_count())) + " = ";
+        expression(options.expression_depth);
+    } else if(kind < 70 || nesting >= 2) {
+        out += "print(";
+        expression(options.expression_depth);
+        out += ")";
+    } else if(kind < 90) {
+        out += "if (";
+        condition();
+        out += ") ";
+        block(1 + pick(3), nesting + 1, indent);
+        if(chance(0.5)) {
+            out += "; else ";
+            block(1 + pick(3), nesting + 1, indent);
+        }
+    } else {
+        out += "while (";
+        condition();
+        out += ") ";
+        block(1 + pick(3), nesting + 1, indent);
+    }
+    out += ";\n";
+}
+
+void ProgramGenerator::block(std::size_t statements, std::size_t nesting, std::size_t indent) {
+    out += "{\n";
+    scopes.emplace_back();
+    for(std::size_t i = 0; i < statements; ++i)
+        statement(nesting, indent + 1);
+    scopes.pop_back();
+    out.append(indent * 4, ' ');
+    out += "}";
+}
+
+bool ProgramGenerator::expression(std::size_t depth) {
+    if(!depth) {
+        if(chance(0.25)) {
+            out += std::to_string(1 + pick(99));
+            return true;
+        }
+        out += visible(pick(visible_count()));
+        return false;
+    }
+    if(!arities.empty() && chance(0.1)) {
+        // Only functions declared before this one, so there's no recursion
+        const auto callee = pick(arities.size());
+        out += function_name(callee) + "(";
+        for(std::size_t i = 0; i < arities[callee]; ++i) {
+            if(i)
+                out += ", ";
+            expression(depth - 1);
+        }
+        out += ")";
+        return false;
+    }
+    static constexpr const char *operators[] = {" + ", " - ", " * ", " / "};
+    const bool parenthesized = chance(0.3);
+    if(parenthesized)
+        out += "(";
+    bool literal = expression(depth - 1);
+    out += operators[pick(std::size(operators))];
+    if(literal)
+        out += visible(pick(visible_count()));
+    else
+        expression(pick(depth));
+    if(parenthesized)
+        out += ")";
+    return false;
+}
+
+void ProgramGenerator::condition() {
+    static constexpr const char *operators[] = {" < ", " > ", " <= ", " >= ", " == ", " != "};
+    const auto depth = std::min<std::size_t>(options.expression_depth, 2);
+    expression(depth);
+    out += operators[pick(std::size(operators))];
+    expression(depth);
+    if(chance(0.2)) {
+        out += chance(0.5) ? " && " : " || ";
+        expression(depth);
+        out += operators[pick(std::size(operators))];
+        expression(depth);
+    }
+}
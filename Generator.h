@@ -0,0 +1,70 @@
+#pragma once
+#ifndef COMPILER_GENERATOR_H
+#define COMPILER_GENERATOR_H
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+// Writes random programs that parse and type check, for benchmarking the compiler on inputs of a chosen shape.
+// The same options and seed always give the same program. Every function takes one to three parameters, declares
+// and assigns locals, prints, branches and loops, calls functions declared before it and ends with a return, and
+// main calls the last one. Expressions never have a subexpression made only of literals, so the type checker
+// has nothing to fold that could overflow.
+class ProgramGenerator {
+public:
+    struct Options {
+        std::uint64_t seed = 1;
+        std::size_t functions = 100;
+        // Top level statements in each function, not counting the ones nested in ifs and loops
+        std::size_t statements = 20;
+        // Operators between the root of an expression and its deepest leaf
+        std::size_t expression_depth = 4;
+        // Distinct names for parameters and locals, shared by all functions
+        std::size_t identifiers = 64;
+        // If set, functions are added until the program is at least this many bytes
+        std::size_t bytes = 0;
+    };
+
+private:
+    Options options;
+    std::mt19937_64 random;
+    std::vector<std::string> names;
+    // Parameter counts of the functions generated so far
+    std::vector<std::size_t> arities;
+    // Names visible at the current statement, innermost scope last
+    std::vector<std::vector<std::size_t>> scopes;
+    std::string out;
+
+public:
+    explicit ProgramGenerator(Options options);
+
+    std::string generate();
+
+private:
+    [[nodiscard]] std::size_t pick(std::size_t count);
+
+    [[nodiscard]] bool chance(double probability);
+
+    [[nodiscard]] std::string function_name(std::size_t index) const;
+
+    [[nodiscard]] bool declared(std::size_t name) const;
+
+    [[nodiscard]] std::size_t visible_count() const;
+
+    [[nodiscard]] const std::string &visible(std::size_t index) const;
+
+    void function(std::size_t index);
+
+    void statement(std::size_t nesting, std::size_t indent);
+
+    void block(std::size_t statements, std::size_t nesting, std::size_t indent);
+
+    // Returns whether the expression is a literal
+    bool expression(std::size_t depth);
+
+    void condition();
+};
+
+#endif //COMPILER_GENERATOR_H
@@ -0,0 +1,140 @@
+#include "Incremental.h"
+#include "Parser.h"
+#include <algorithm>
+#include <span>
+#include <spanstream>
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_set>
+
+namespace {
+    // The transpiled code covers everything in the tree, and a freshly parsed function has no annotations yet
+    bool same_tree(AST::FunctionNode &a, AST::FunctionNode &b) {
+        std::ostringstream first, second;
+        a.transpile(first);
+        b.transpile(second);
+        return first.str() == second.str();
+    }
+}
+
+IncrementalParser::IncrementalParser(std::string source) : source(std::move(source)) {
+    parse_all();
+}
+
+IncrementalParser::Changes IncrementalParser::parse_all() {
+    valid = false;
+    Parser parser(std::istringstream{source});
+    parser.parse_program();
+
+    Changes changes;
+    changes.reparsed = source.size();
+    auto &parsed = parser.get_functions();
+    std::unordered_set<Identifier> names;
+    for(const auto &function : parsed)
+        names.insert(function->name);
+    for(const auto &function : functions) {
+        if(!names.contains(function->name))
+            changes.removed.push_back(function->name);
+    }
+    for(auto &function : parsed) {
+        auto it = function_index.find(function->name);
+        if(it == function_index.end())
+            changes.added.push_back(function->name);
+        else if(same_tree(*functions[it->second], *function))
+            function = std::move(functions[it->second]);
+        else
+            changes.changed.push_back(function->name);
+    }
+
+    functions = std::move(parsed);
+    spans = parser.get_function_spans();
+    function_index.clear();
+    for(std::size_t i = 0; i < functions.size(); ++i)
+        function_index[functions[i]->name] = i;
+    valid = true;
+    return changes;
+}
+
+IncrementalParser::Changes IncrementalParser::apply(const TextEdit &edit) {
+    if(edit.offset > source.size() || edit.removed > source.size() - edit.offset)
+        throw std::out_of_range("Edit outside of the source");
+    source.replace(edit.offset, edit.removed, edit.inserted);
+    if(!valid)
+        return parse_all();
+
+    const auto edit_end = edit.offset + edit.removed;
+    // Where an offset from before the edit ended up, removed text maps to the start of the edit
+    auto moved = [&](std::size_t offset) {
+        if(offset < edit.offset)
+            return offset;
+        if(offset < edit_end)
+            return edit.offset;
+        return offset - edit.removed + edit.inserted.size();
+    };
+
+    // Functions [first, last) touch the edit
+    auto first = static_cast<std::size_t>(std::ranges::partition_point(spans, [&](const auto &span) {
+        return span.second < edit.offset;
+    }) - spans.begin());
+    auto last = static_cast<std::size_t>(std::ranges::partition_point(spans, [&](const auto &span) {
+        return span.first <= edit_end;
+    }) - spans.begin());
+    std::size_t begin = edit.offset, end = edit.offset + edit.inserted.size();
+    if(first < last) {
+        begin = std::min(begin, spans[first].first);
+        end = std::max(end, moved(spans[last - 1].second));
+    }
+
+    // Tokens and comments never cross a line, so whole lines can be lexed on their own. Any function sharing a
+    // line with the window is part of it, which can pull in more lines.
+    for(bool grown = true; grown;) {
+        const auto line = begin ? source.rfind('\n', begin - 1) : std::string::npos;
+        begin = line == std::string::npos ? 0 : line + 1;
+        end = std::min(source.find('\n', end), source.size());
+        grown = false;
+        for(; first > 0 && spans[first - 1].second > begin; grown = true)
+            begin = std::min(begin, spans[--first].first);
+        for(; last < spans.size() && moved(spans[last].first) < end; grown = true)
+            end = std::max(end, moved(spans[last++].second));
+    }
+
+    Parser parser(std::ispanstream(std::span<const char>(source.data() + begin, end - begin)));
+    parser.set_function_lookup([this, first](const Identifier &name) -> std::optional<Signature> {
+        auto it = function_index.find(name);
+        if(it == function_index.end() || it->second >= first)
+            return std::nullopt;
+        return functions[it->second]->signature();
+    });
+    try {
+        parser.parse_program();
+    } catch(const std::runtime_error &) {
+        // Parsed again from the start, so the error is reported where a full parse would report it
+        return parse_all();
+    }
+
+    // Other functions may call the ones in the window, so if their names or signatures changed they are checked again
+    auto &parsed = parser.get_functions();
+    if(parsed.size() != last - first)
+        return parse_all();
+    for(std::size_t i = 0; i < parsed.size(); ++i) {
+        const auto &old = *functions[first + i];
+        if(parsed[i]->name != old.name || parsed[i]->signature() != old.signature())
+            return parse_all();
+    }
+
+    Changes changes;
+    changes.reparsed = end - begin;
+    for(std::size_t i = 0; i < parsed.size(); ++i) {
+        auto &function = functions[first + i];
+        if(!same_tree(*function, *parsed[i])) {
+            changes.changed.push_back(function->name);
+            function = std::move(parsed[i]);
+        }
+        const auto &[function_begin, function_end] = parser.get_function_spans()[i];
+        spans[first + i] = {begin + function_begin, begin + function_end};
+    }
+    for(auto i = last; i < spans.size(); ++i)
+        spans[i] = {moved(spans[i].first), moved(spans[i].second)};
+    return changes;
+}
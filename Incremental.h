@@ -0,0 +1,58 @@
+#pragma once
+#ifndef COMPILER_INCREMENTAL_H
+#define COMPILER_INCREMENTAL_H
+
+#include "ASTNode.h"
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+struct TextEdit {
+    std::size_t offset;
+    // Number of bytes removed at offset
+    std::size_t removed;
+    std::string inserted;
+};
+
+// Keeps a parsed program up to date with edits to its source. Only the lines around an edit are lexed again,
+// and only the functions on them are parsed again. Functions that parse to the same tree keep their node, so
+// anything keyed on them stays valid.
+class IncrementalParser {
+public:
+    struct Changes {
+        std::vector<Identifier> changed;
+        std::vector<Identifier> added;
+        std::vector<Identifier> removed;
+        // Bytes of source that were lexed and parsed again
+        std::size_t reparsed = 0;
+    };
+
+private:
+    std::string source;
+    std::vector<AST::FunctionNodePtr> functions;
+    // Byte range of every function in the source, in the same order as the functions
+    std::vector<std::pair<std::size_t, std::size_t>> spans;
+    std::unordered_map<Identifier, std::size_t> function_index;
+    // False after an edit that didn't parse, the next edit parses everything again
+    bool valid = false;
+
+public:
+    // Throws SyntaxErrorException if the program is malformed
+    explicit IncrementalParser(std::string source);
+
+    // Throws SyntaxErrorException if the edited program is malformed, with the same position a full parse would give.
+    // The source is still edited, so the next edit can fix the error.
+    Changes apply(const TextEdit &edit);
+
+    [[nodiscard]] const std::string &get_source() const { return source; }
+
+    // Stale while the source doesn't parse
+    [[nodiscard]] const std::vector<AST::FunctionNodePtr> &get_functions() const { return functions; }
+
+private:
+    Changes parse_all();
+};
+
+#endif //COMPILER_INCREMENTAL_H
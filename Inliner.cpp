@@ -0,0 +1,179 @@
+#include "Inliner.h"
+#include <algorithm>
+#include <unordered_map>
+
+static bool is_trivial(const AST::Node &node) {
+    return dynamic_cast<const AST::IntegerLiteralNode *>(&node) || dynamic_cast<const AST::IdentifierNode *>(&node);
+}
+
+// What in the expression has to be evaluated even if its value isn't used, nullptr if nothing
+static const char *effect_in(AST::Node &node) {
+    const char *found = nullptr;
+    AST::for_each(node, [&](AST::Node &child) {
+        if(found)
+            return;
+        if(dynamic_cast<AST::FunctionCall *>(&child))
+            found = "a call";
+        else if(auto *index = dynamic_cast<AST::IndexNode *>(&child); index && index->checked)
+            found = "a checked array access";
+    });
+    return found;
+}
+
+static std::size_t count_uses(AST::Node &node, const Identifier &name) {
+    std::size_t uses = 0;
+    AST::for_each(node, [&](AST::Node &child) {
+        if(auto *id = dynamic_cast<AST::IdentifierNode *>(&child); id && id->identifier == name)
+            ++uses;
+    });
+    return uses;
+}
+
+// Whether the name is used where it might not be evaluated: right of && or ||, or in an arm of an if expression
+static bool used_conditionally(AST::Node &node, const Identifier &name) {
+    bool used = false;
+    AST::for_each(node, [&](AST::Node &child) {
+        if(auto *binary = dynamic_cast<AST::BinaryOpNode *>(&child);
+           binary && (binary->op == Operator::LogicalAnd || binary->op == Operator::LogicalOr)) {
+            used = used || count_uses(*binary->right, name);
+        } else if(auto *conditional = dynamic_cast<AST::ConditionalNode *>(&child)) {
+            used = used || count_uses(*conditional->then, name) || count_uses(*conditional->otherwise, name);
+        }
+    });
+    return used;
+}
+
+static void substitute(AST::NodePtr &slot, const std::unordered_map<Identifier, AST::Node *> &arguments) {
+    if(auto *id = dynamic_cast<AST::IdentifierNode *>(slot.get())) {
+        auto it = arguments.find(id->identifier);
+        if(it != arguments.end())
+            slot = it->second->clone();
+        return;
+    }
+    for(auto *child : slot->children()) {
+        if(*child)
+            substitute(*child, arguments);
+    }
+}
+
+static AST::ReturnNode *single_return(const AST::FunctionNode &function) {
+    if(function.statements.size() != 1)
+        return nullptr;
+    return dynamic_cast<AST::ReturnNode *>(function.statements.front().get());
+}
+
+Inliner &Inliner::run(std::vector<AST::FunctionNodePtr> &functions) {
+    CallGraph graph(functions);
+    std::unordered_map<Identifier, std::size_t> inlined_sites;
+
+    // Bottom-up over the SCCs, so callees are already simplified when they get copied into their callers
+    for(const auto &scc : graph.sccs()) {
+        for(const auto &name : scc) {
+            auto *caller = graph.function(name);
+            for(auto &statement : caller->statements)
+                inline_calls(*caller, statement, graph, inlined_sites);
+        }
+    }
+
+    if(options.remove_dead_functions) {
+        std::erase_if(functions, [&](const AST::FunctionNodePtr &function) {
+            auto sites = graph.call_sites(function->name);
+            if(function->name == "main" || sites == 0 || inlined_sites[function->name] != sites)
+                return false;
+            removed.push_back(function->name);
+            return true;
+        });
+    }
+    return *this;
+}
+
+void Inliner::inline_calls(AST::FunctionNode &caller, AST::NodePtr &slot, const CallGraph &graph,
+                           std::unordered_map<Identifier, std::size_t> &inlined_sites) {
+    for(auto *child : slot->children()) {
+        if(*child)
+            inline_calls(caller, *child, graph, inlined_sites);
+    }
+
+    auto *call = dynamic_cast<AST::FunctionCall *>(slot.get());
+    if(!call)
+        return;
+    auto *callee = graph.function(call->identifier);
+    if(!callee)
+        return; // Builtin
+
+    auto [inline_it, reason] = decide(caller, *callee, *call, graph);
+    decisions.push_back({caller.name, callee->name, inline_it, std::move(reason)});
+    if(!inline_it)
+        return;
+
+    std::unordered_map<Identifier, AST::Node *> arguments;
+    for(std::size_t i = 0; i < callee->parameters.size(); ++i)
+        arguments[callee->parameters[i]] = call->arguments[i].get();
+
+    auto body = single_return(*callee)->expression->clone();
+    substitute(body, arguments);
+    slot = std::move(body);
+    ++inlined_sites[callee->name];
+}
+
+std::pair<bool, std::string> Inliner::decide(AST::FunctionNode &caller, const AST::FunctionNode &callee,
+                                             AST::FunctionCall &call, const CallGraph &graph) const {
+    if(caller.name == callee.name)
+        return {false, "recursive call"};
+    if(graph.same_component(caller.name, callee.name))
+        return {false, "recursive, " + callee.name + " is in the same SCC as " + caller.name};
+    if(graph.is_recursive(callee.name))
+        return {false, "callee is recursive"};
+
+    auto *ret = single_return(callee);
+    if(!ret)
+        return {false, "body is not a single return expression"};
+    // The call converts the arguments and the result, the substituted expression would be evaluated in the
+    // caller's types instead
+    auto signature = callee.signature();
+    if(signature.result != IntegerType::Int
+       || std::ranges::any_of(signature.parameters, [](IntegerType type) { return type != IntegerType::Int; }))
+        return {false, "has sized types"};
+
+    auto callee_size = AST::size(*ret->expression);
+    auto sites = graph.call_sites(callee.name);
+    std::string reason;
+    if(callee_size <= options.always_inline_size) {
+        reason = "size " + std::to_string(callee_size) + " <= " + std::to_string(options.always_inline_size);
+    } else if(options.hot_functions.contains(callee.name) && callee_size <= options.hot_size) {
+        reason = "hot in the profile, size " + std::to_string(callee_size) + " <= "
+                 + std::to_string(options.hot_size);
+    } else if(sites == 1 && callee_size <= options.single_call_size) {
+        reason = "single call site, size " + std::to_string(callee_size) + " <= "
+                 + std::to_string(options.single_call_size);
+    } else {
+        return {false, "too large, size " + std::to_string(callee_size) + " with " + std::to_string(sites)
+                       + " call sites"};
+    }
+
+    if(AST::size(caller) + callee_size > options.max_caller_size)
+        return {false, "caller size budget of " + std::to_string(options.max_caller_size) + " exhausted"};
+
+    for(std::size_t i = 0; i < callee.parameters.size(); ++i) {
+        auto uses = count_uses(*ret->expression, callee.parameters[i]);
+        auto &argument = *call.arguments[i];
+        if(uses > 1 && !is_trivial(argument))
+            return {false, "argument " + std::to_string(i + 1) + " would be evaluated " + std::to_string(uses)
+                           + " times"};
+        auto *effect = effect_in(argument);
+        if(effect && uses == 0)
+            return {false, "argument " + std::to_string(i + 1) + " has " + effect + " that would be dropped"};
+        if(effect && used_conditionally(*ret->expression, callee.parameters[i]))
+            return {false, "argument " + std::to_string(i + 1) + " has " + effect + " that might not be evaluated"};
+    }
+    return {true, reason};
+}
+
+void Inliner::print_report(std::ostream &out) const {
+    for(const auto &decision : decisions) {
+        out << "inline: " << decision.callee << " into " << decision.caller << ": "
+            << (decision.inlined ? "inlined, " : "not inlined, ") << decision.reason << '\n';
+    }
+    for(const auto &name : removed)
+        out << "inline: " << name << " removed, every call site was inlined\n";
+}
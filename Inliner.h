@@ -0,0 +1,63 @@
+#pragma once
+#ifndef COMPILER_INLINER_H
+#define COMPILER_INLINER_H
+
+#include "ASTNode.h"
+#include "CallGraph.h"
+#include <ostream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// Replaces calls to small non-recursive functions with a copy of their body.
+// Only functions whose body is a single return statement are candidates, since
+// the language has no way to evaluate a block as an expression.
+class Inliner {
+public:
+    struct Options {
+        // Callees at most this many nodes are always inlined
+        std::size_t always_inline_size = 8;
+        // Callees with a single call site in the program are inlined up to this size
+        std::size_t single_call_size = 64;
+        // Callees that are hot in the profile are inlined up to this size, wherever they are called from
+        std::unordered_set<Identifier> hot_functions;
+        std::size_t hot_size = 64;
+        // Stop inlining into a caller once it grows past this many nodes
+        std::size_t max_caller_size = 512;
+        // Drop functions that have no call sites left after inlining
+        bool remove_dead_functions = true;
+    };
+
+    struct Decision {
+        Identifier caller;
+        Identifier callee;
+        bool inlined;
+        std::string reason;
+    };
+
+private:
+    Options options;
+    std::vector<Decision> decisions;
+    std::vector<Identifier> removed;
+
+public:
+    Inliner() = default;
+
+    explicit Inliner(Options options) : options(options) {}
+
+    Inliner &run(std::vector<AST::FunctionNodePtr> &functions);
+
+    [[nodiscard]] const std::vector<Decision> &report() const { return decisions; }
+
+    void print_report(std::ostream &) const;
+
+private:
+    void inline_calls(AST::FunctionNode &caller, AST::NodePtr &slot, const CallGraph &,
+                      std::unordered_map<Identifier, std::size_t> &inlined_sites);
+
+    // Whether the call should be inlined, and a human readable reason for the report
+    std::pair<bool, std::string> decide(AST::FunctionNode &caller, const AST::FunctionNode &callee,
+                                        AST::FunctionCall &call, const CallGraph &) const;
+};
+
+#endif //COMPILER_INLINER_H
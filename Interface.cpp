@@ -0,0 +1,126 @@
+#include "Interface.h"
+#include "Lexer.h"
+#include "Types.h"
+#include <sstream>
+
+static constexpr std::string_view interface_magic = "arji2";
+
+static std::optional<IntegerType> parse_type(std::string_view name) {
+    return name == Types::name(IntegerType::Int) ? IntegerType::Int : Types::parse(name);
+}
+
+Interface Interface::scan(Identifier module, const std::string &source) {
+    Interface interface{std::move(module), {}, {}};
+    Lexer lexer(std::istringstream{source});
+    auto token = lexer.getNextToken();
+
+    while (token == Token(Keyword::Import)) {
+        token = lexer.getNextToken();
+        if (!std::holds_alternative<Identifier>(token))
+            throw SyntaxErrorException("Expected module name after import");
+        interface.imports.push_back(std::get<Identifier>(token));
+        if (lexer.getNextToken() != Token(Punctuation::Semicolon))
+            throw SyntaxErrorException("Expected semicolon after import");
+        token = lexer.getNextToken();
+    }
+
+    // [memo] fn name ( parameters ) { body }
+    while (!std::holds_alternative<EndToken>(token)) {
+        if (token == Token(Keyword::Memo))
+            token = lexer.getNextToken();
+        if (token != Token(Keyword::Fn))
+            throw SyntaxErrorException("Expected the fn keyword to declare the function");
+        token = lexer.getNextToken();
+        if (!std::holds_alternative<Identifier>(token))
+            throw SyntaxErrorException("Expected function name");
+        auto name = std::get<Identifier>(token);
+
+        // ( [name [: type]] , ... ) [-> type] {
+        Signature signature;
+        auto type = [&] {
+            token = lexer.getNextToken();
+            auto parsed = std::holds_alternative<Identifier>(token) ? Types::parse(std::get<Identifier>(token))
+                                                                     : std::nullopt;
+            if (!parsed)
+                throw SyntaxErrorException("Expected a type");
+            token = lexer.getNextToken();
+            return *parsed;
+        };
+        if (lexer.getNextToken() != Token(Punctuation::OpenParen))
+            throw SyntaxErrorException("Expected opening parenthesis");
+        for (token = lexer.getNextToken(); std::holds_alternative<Identifier>(token);) {
+            token = lexer.getNextToken();
+            signature.parameters.push_back(token == Token(Punctuation::Colon) ? type() : IntegerType::Int);
+            if (token == Token(Punctuation::Comma))
+                token = lexer.getNextToken();
+        }
+        if (token != Token(Punctuation::CloseParen))
+            throw SyntaxErrorException("Expected closing parenthesis");
+        token = lexer.getNextToken();
+        if (token == Token(Operator::RightArrow))
+            signature.result = type();
+        if (token != Token(Punctuation::OpenBrace))
+            throw SyntaxErrorException("Expected opening brace after function declaration");
+        for (std::size_t depth = 1; depth > 0;) {
+            token = lexer.getNextToken();
+            if (std::holds_alternative<EndToken>(token))
+                throw SyntaxErrorException("Expected closing brace");
+            if (token == Token(Punctuation::OpenBrace))
+                ++depth;
+            else if (token == Token(Punctuation::CloseBrace))
+                --depth;
+        }
+        interface.functions.emplace_back(std::move(name), std::move(signature));
+        token = lexer.getNextToken();
+    }
+    return interface;
+}
+
+Interface Interface::read(std::istream &in) {
+    Interface interface;
+    std::string magic, kind;
+    if (!(in >> magic >> kind >> interface.module) || magic != interface_magic || kind != "module")
+        throw std::runtime_error("Malformed interface file");
+    // fn name result parameters...
+    for (std::string line; std::getline(in, line);) {
+        std::istringstream fields(line);
+        if (!(fields >> kind))
+            continue;
+        Identifier name;
+        if (!(fields >> name))
+            throw std::runtime_error("Malformed interface file");
+        if (kind == "import") {
+            interface.imports.push_back(std::move(name));
+            continue;
+        }
+        if (kind != "fn")
+            throw std::runtime_error("Malformed interface file");
+        Signature signature;
+        std::string type;
+        for (bool result = true; fields >> type; result = false) {
+            auto parsed = parse_type(type);
+            if (!parsed)
+                throw std::runtime_error("Malformed interface file");
+            if (result)
+                signature.result = *parsed;
+            else
+                signature.parameters.push_back(*parsed);
+        }
+        if (type.empty())
+            throw std::runtime_error("Malformed interface file");
+        interface.functions.emplace_back(std::move(name), std::move(signature));
+    }
+    return interface;
+}
+
+void Interface::write(std::ostream &out) const {
+    out << interface_magic << "\nmodule " << module << '\n';
+    for (const auto &name : imports)
+        out << "import " << name << '\n';
+    for (const auto &[name, signature] : functions) {
+        out << "fn " << name << ' ' << Types::name(signature.result);
+        for (auto type : signature.parameters)
+            out << ' ' << Types::name(type);
+        out << '\n';
+    }
+}
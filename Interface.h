@@ -0,0 +1,31 @@
+#pragma once
+#ifndef COMPILER_INTERFACE_H
+#define COMPILER_INTERFACE_H
+
+#include "ASTNode.h"
+#include <istream>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// What other modules need to know about a module: the functions it exports and what it imports.
+// Stored as a small text file (.arji) next to the generated code, so modules can be compiled against
+// precompiled interfaces without their source.
+struct Interface {
+    Identifier module;
+    std::vector<Identifier> imports;
+    // Every top-level function is exported
+    std::vector<std::pair<Identifier, Signature>> functions;
+
+    // Only looks at the tokens of the import statements and function headers, so it is much cheaper than parsing.
+    // Throws SyntaxErrorException if those are malformed.
+    static Interface scan(Identifier module, const std::string &source);
+
+    // Throws std::runtime_error on a malformed file
+    static Interface read(std::istream &in);
+
+    void write(std::ostream &out) const;
+};
+
+#endif //COMPILER_INTERFACE_H
@@ -2,7 +2,13 @@
 // Created by Arvid Jonasson on 2023-10-07.
 //
 #include "Lexer.h"
+#include "RingBuffer.h"
+#include "Stats.h"
+#include <exception>
 #include <unordered_map>
+#include <limits>
+#include <optional>
+#include <thread>
 
 struct InternalData {
     const static std::unordered_map<std::string, Keyword> keywords;
@@ -16,6 +22,10 @@ const std::unordered_map<std::string, Keyword> InternalData::keywords{
         {"if",       Keyword::If},
         {"else",     Keyword::Else},
         {"let",      Keyword::Let},
+        {"memo",     Keyword::Memo},
+        {"import",   Keyword::Import},
+        {"while",    Keyword::While},
+        {"for",      Keyword::For},
 };
 
 const std::unordered_map<std::string, Operator> InternalData::operators{
@@ -41,6 +51,8 @@ const std::unordered_map<std::string, Operator> InternalData::operators{
         {"&&", Operator::LogicalAnd},
         {"||", Operator::LogicalOr},
         {"!",  Operator::LogicalNot},
+
+        {"->", Operator::RightArrow},
 };
 
 const std::unordered_map<std::string, Punctuation> InternalData::punctuations{
@@ -50,21 +62,104 @@ const std::unordered_map<std::string, Punctuation> InternalData::punctuations{
         {"}",  Punctuation::CloseBrace},
         {",",  Punctuation::Comma},
         {";",  Punctuation::Semicolon},
+        {":",  Punctuation::Colon},
+        {"[",  Punctuation::OpenBracket},
+        {"]",  Punctuation::CloseBracket},
+};
+
+struct Lexer::Pipeline {
+    struct Item {
+        TokenAndPos token;
+        // Thrown by the lexer, the last item
+        std::exception_ptr error;
+    };
+
+    RingBuffer<Item, 4096> ring;
+    // Returned again once the end has been reached, since the thread has stopped
+    std::optional<TokenAndPos> end;
+    // Last, so it is joined before the ring is destroyed
+    std::jthread thread;
+
+    // Short waits are spent spinning, longer ones give the core to the other thread
+    template<typename F>
+    static void wait_until(F &&ready, const std::stop_token &stop = {}) {
+        for (unsigned spins = 0; !ready() && !stop.stop_requested(); ++spins) {
+            if (spins < 128) {
+#if defined(__x86_64__) || defined(__i386__)
+                __builtin_ia32_pause();
+#endif
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    }
 };
 
+void Lexer::PipelineDeleter::operator()(Pipeline *pipeline) const {
+    delete pipeline;
+}
+
+Lexer::~Lexer() = default;
+
+void Lexer::start_pipeline() {
+    pipeline.reset(new Pipeline);
+    pipeline->thread = std::jthread([this](std::stop_token stop) {
+        for (bool done = false; !done && !stop.stop_requested();) {
+            Pipeline::Item item;
+            try {
+                item.token = parseNextToken();
+                done = std::holds_alternative<EndToken>(item.token.first);
+            } catch (...) {
+                item.error = std::current_exception();
+                done = true;
+            }
+            Pipeline::wait_until([&] { return pipeline->ring.try_push(item); }, stop);
+        }
+    });
+}
+
+void Lexer::stop_pipeline() {
+    if (!pipeline)
+        return;
+    pipeline->thread.request_stop();
+    pipeline->thread.join();
+    pipeline.reset();
+}
+
 Token Lexer::getNextToken() {
     TokenAndPos token;
     if (!tokens.empty()) {
         token = std::move(tokens.front());
         tokens.pop_front();
     } else {
-        token = parseNextToken();
+        token = nextTokenAndPos();
     }
     lastTokenPos = token.second;
     return token.first;
 }
 
+Lexer::TokenAndPos Lexer::nextTokenAndPos() {
+    try {
+        STATS_COUNT(Tokens);
+        if (!pipeline)
+            return parseNextToken();
+        if (pipeline->end)
+            return *pipeline->end;
+        Pipeline::Item item;
+        Pipeline::wait_until([&] { return pipeline->ring.try_pop(item); });
+        if (item.error)
+            std::rethrow_exception(item.error);
+        if (std::holds_alternative<EndToken>(item.token.first))
+            pipeline->end = item.token;
+        return std::move(item.token);
+    } catch (SyntaxErrorException const &e) {
+        auto [line, position] = getErrorPosition();
+        throw SyntaxErrorException(e.what(), line, position);
+    }
+}
+
 Lexer::TokenAndPos Lexer::parseNextToken() {
+    STATS_PHASE(Lex);
     while (std::isspace(source->peek())) {
         source->ignore();
     }
@@ -85,17 +180,12 @@ Lexer::TokenAndPos Lexer::parseNextToken() {
         }
         source->unget();
     }
-    try {
-        if (std::isdigit(c)) {
-            return std::make_pair(parseDigit(), tokenPos);
-        } else if (std::isalpha(c)) {
-            return std::make_pair(parseAlpha(), tokenPos);
-        } else if (std::ispunct(c)) {
-            return std::make_pair(parsePunct(), tokenPos);
-        }
-    } catch (SyntaxErrorException const &e) {
-        auto [line, position] = getErrorPosition();
-        throw SyntaxErrorException(e.what(), line, position);
+    if (std::isdigit(c)) {
+        return std::make_pair(parseDigit(), tokenPos);
+    } else if (std::isalpha(c)) {
+        return std::make_pair(parseAlpha(), tokenPos);
+    } else if (std::ispunct(c)) {
+        return std::make_pair(parsePunct(), tokenPos);
     }
 
     throw std::runtime_error("Unknown character with value " + std::to_string(c));
@@ -105,8 +195,8 @@ Token Lexer::lookAhead(std::int_least32_t x) {
     if (x <= 0)
         throw std::invalid_argument("Expected to look ahead more than 0 tokens, you asked to look ahead "
                                     + std::to_string(x) + " elements");
-    while (x <= tokens.size()) {
-        tokens.emplace_back(std::move(parseNextToken()));
+    while (tokens.size() < static_cast<std::size_t>(x)) {
+        tokens.emplace_back(nextTokenAndPos());
     }
     return tokens[x - 1].first;
 }
@@ -160,14 +250,20 @@ Token Lexer::parsePunct() {
 }
 
 std::pair<unsigned int, unsigned int> Lexer::getErrorPosition() {
+    // The source is read again from the start, which the lexer thread can't be doing at the same time
+    stop_pipeline();
     unsigned int line = 1, position = 1;
 
     auto error_pos = lastTokenPos;
 
-    // Restart from the beginning and count the number of lines and where in the line we are
+    // Restart from the beginning and count the number of lines and where in the line we are.
+    // Reaching the end fails the stream, the end token then has position 0 and the whole input is counted.
+    source->clear();
     source->seekg(0, std::ios::beg);
-    while (source->tellg() < error_pos) {
+    while (error_pos == 0 || source->tellg() < error_pos) {
         switch (source->get()) {
+            case EOF:
+                return std::make_pair(line, position);
             case '\n':
                 ++line;
                 position = 1;
@@ -37,6 +37,12 @@ private:
     std::unique_ptr<std::istream> source;
     std::istream::pos_type lastTokenPos = 0;
     std::deque<TokenAndPos> tokens;
+    // Set while tokens are lexed ahead on another thread
+    struct Pipeline;
+    struct PipelineDeleter {
+        void operator()(Pipeline *) const;
+    };
+    std::unique_ptr<Pipeline, PipelineDeleter> pipeline;
 
 public:
     Lexer() = delete;
@@ -54,15 +60,31 @@ public:
     template<InputStreamRef T>
     explicit Lexer(T &&source) : Lexer(std::make_unique<T>(std::forward<T>(source))) {}
 
+    ~Lexer();
+
+    // Lexes the rest of the source on its own thread, handing tokens over through a ring buffer. Has to be called
+    // before the first token is read. The thread is stopped before the source is read again to find the position
+    // of an error.
+    void start_pipeline();
+
     [[nodiscard]] Token getNextToken();
 
     [[nodiscard]] Token lookAhead(std::int_least32_t);
 
+    // Byte offset in the source of the token last returned by getNextToken
+    [[nodiscard]] std::size_t getTokenOffset() const { return static_cast<std::size_t>(lastTokenPos) - 1; }
+
     std::pair<unsigned int, unsigned int> getErrorPosition();
 
 private:
+    // The next token from the pipeline or the source, with the position of a syntax error in it
+    [[nodiscard]] TokenAndPos nextTokenAndPos();
+
+    // Throws SyntaxErrorException without a position
     [[nodiscard]] TokenAndPos parseNextToken();
 
+    void stop_pipeline();
+
     Token parseDigit();
 
     Token parseAlpha();
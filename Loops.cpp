@@ -0,0 +1,537 @@
+#include "Loops.h"
+#include "Types.h"
+#include <algorithm>
+#include <functional>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace {
+    using Types::Wide;
+    using Variables = std::unordered_map<Identifier, IntegerType>;
+
+    template<typename F>
+    bool contains(AST::Node &node, F &&predicate) {
+        bool found = false;
+        AST::for_each(node, [&](AST::Node &child) {
+            found = found || predicate(child);
+        });
+        return found;
+    }
+
+    bool assigns(AST::Node &node, const Identifier &name) {
+        return contains(node, [&](AST::Node &child) {
+            auto *assignment = dynamic_cast<AST::AssignmentNode *>(&child);
+            return assignment && assignment->name == name;
+        });
+    }
+
+    std::string text(AST::Node &node) {
+        std::ostringstream out;
+        node.transpile(out);
+        return std::move(out).str();
+    }
+
+    bool is_relational(Operator op) {
+        return op == Operator::LessThan || op == Operator::LessThanOrEq
+               || op == Operator::GreaterThan || op == Operator::GreaterThanOrEq;
+    }
+
+    // The type C++ evaluates an expression without calls or conditionals in
+    IntegerType evaluated_type(AST::Node &node, const Variables &variables) {
+        if(auto *literal = dynamic_cast<AST::IntegerLiteralNode *>(&node))
+            return Types::literal(literal->value);
+        if(auto *id = dynamic_cast<AST::IdentifierNode *>(&node)) {
+            auto it = variables.find(id->identifier);
+            return it == variables.end() ? IntegerType::Int : it->second;
+        }
+        auto &binary = dynamic_cast<AST::BinaryOpNode &>(node);
+        if(!Types::is_arithmetic(binary.op))
+            return IntegerType::Int;
+        return Types::arithmetic(evaluated_type(*binary.left, variables), evaluated_type(*binary.right, variables));
+    }
+
+    AST::NodePtr binary(Operator op, AST::NodePtr left, AST::NodePtr right) {
+        return std::make_unique<AST::BinaryOpNode>(op, std::move(left), std::move(right));
+    }
+
+    AST::NodePtr identifier(const Identifier &name) {
+        return std::make_unique<AST::IdentifierNode>(name);
+    }
+
+    // i < bound, with i = i + step as the last statement of the body
+    struct Counter {
+        Identifier name;
+        Operator comparison;
+        // Set if the bound is a literal rather than a variable the loop doesn't assign
+        std::optional<Wide> bound;
+        Wide step;
+        // Set if i is set to a literal right before the loop
+        std::optional<Wide> start;
+        std::optional<Wide> iterations;
+    };
+
+    class FunctionLoops {
+        const LoopOptimizer::Options &options;
+        AST::FunctionNode &function;
+        std::vector<LoopOptimizer::Transformation> &transformations;
+        std::size_t temporaries = 0;
+
+    public:
+        FunctionLoops(const LoopOptimizer::Options &options, AST::FunctionNode &function,
+                      std::vector<LoopOptimizer::Transformation> &transformations) :
+                options(options), function(function), transformations(transformations) {}
+
+        void run() {
+            Variables variables;
+            for(std::size_t i = 0; i < function.parameters.size(); ++i)
+                variables[function.parameters[i]] = function.parameter_types[i];
+            statements(function.statements, variables);
+        }
+
+    private:
+        // The literal the variable is set to by the statements before list[index], if nothing changes it after
+        static auto start_value(std::vector<AST::NodePtr> &list, std::size_t index) {
+            return [&list, index](const Identifier &name) -> std::optional<Wide> {
+                for(auto i = index; i-- > 0;) {
+                    AST::NodePtr *value = nullptr;
+                    if(auto *declaration = dynamic_cast<AST::DeclarationNode *>(list[i].get());
+                       declaration && declaration->name == name)
+                        value = &declaration->expression;
+                    else if(auto *assignment = dynamic_cast<AST::AssignmentNode *>(list[i].get());
+                            assignment && assignment->name == name)
+                        value = &assignment->expression;
+                    if(value) {
+                        auto *literal = dynamic_cast<AST::IntegerLiteralNode *>(value->get());
+                        return literal ? std::optional<Wide>(literal->value) : std::nullopt;
+                    }
+                    if(assigns(*list[i], name))
+                        return std::nullopt;
+                }
+                return std::nullopt;
+            };
+        }
+
+        void statements(std::vector<AST::NodePtr> &list, Variables variables) {
+            for(std::size_t i = 0; i < list.size(); ++i) {
+                if(dynamic_cast<AST::WhileNode *>(list[i].get()))
+                    loop(list[i], variables, start_value(list, i));
+                else
+                    statement(list[i], variables);
+            }
+        }
+
+        void statement(AST::NodePtr &slot, Variables &variables) {
+            if(auto *declaration = dynamic_cast<AST::DeclarationNode *>(slot.get())) {
+                variables[declaration->name] = declaration->type;
+            } else if(auto *block = dynamic_cast<AST::BlockNode *>(slot.get())) {
+                statements(block->statements, variables);
+            } else if(auto *branch = dynamic_cast<AST::IfNode *>(slot.get())) {
+                auto inner = variables;
+                statement(branch->statement, inner);
+                if(branch->elseStatement) {
+                    inner = variables;
+                    statement(branch->elseStatement, inner);
+                }
+            } else if(dynamic_cast<AST::WhileNode *>(slot.get())) {
+                loop(slot, variables, [](const Identifier &) { return std::optional<Wide>(); });
+            }
+        }
+
+        template<typename Start>
+        void loop(AST::NodePtr &slot, Variables &variables, Start &&start) {
+            auto &node = dynamic_cast<AST::WhileNode &>(*slot);
+            {
+                auto inner = variables;
+                statement(node.body, inner);
+            }
+            // Loops made by the TailCallOptimizer, which jump with continue
+            if(!node.condition || contains(*node.body, [](AST::Node &child) {
+                return dynamic_cast<AST::ContinueNode *>(&child) != nullptr;
+            }))
+                return;
+
+            LoopOptimizer::Transformation transformation{function.name, {}};
+            auto counter = counted(node, variables, start);
+            if(counter)
+                transformation.counter = counter->name;
+
+            if(counter && counter->iterations && *counter->iterations <= Wide(options.max_unroll_iterations)
+               && *counter->iterations * Wide(AST::size(*node.body)) <= Wide(options.max_unrolled_size)) {
+                // The condition has no calls, so dropping it changes nothing
+                std::vector<AST::NodePtr> copies;
+                for(Wide i = 0; i < *counter->iterations; ++i)
+                    copies.emplace_back(node.body->clone());
+                transformation.unrolled = copies.size();
+                transformation.removed = true;
+                slot = std::make_unique<AST::BlockNode>(std::move(copies));
+                transformations.push_back(std::move(transformation));
+                return;
+            }
+
+            std::vector<AST::NodePtr> prologue;
+            auto guard = node.condition->clone();
+            if(!contains(*node.condition, [](AST::Node &child) {
+                return dynamic_cast<AST::FunctionCall *>(&child) != nullptr;
+            })) {
+                auto scope = variables;
+                if(options.hoist)
+                    transformation.hoisted = hoist(node, scope, prologue);
+                if(options.strength_reduce && counter)
+                    transformation.reduced = strength_reduce(node, *counter, scope, prologue);
+            }
+
+            if(options.vectorize && counter)
+                transformation.vectorized = node.vectorize = vectorizable(node, counter->name);
+
+            // Only innermost loops, copying an inner loop only makes the code larger. Vectorized loops are left
+            // for the C++ compiler to unroll.
+            if(counter && counter->iterations && !node.vectorize && options.unroll_factor > 1
+               && *counter->iterations % Wide(options.unroll_factor) == 0
+               && Wide(options.unroll_factor) * Wide(AST::size(*node.body)) <= Wide(options.max_unrolled_size)
+               && !contains(*node.body, [](AST::Node &child) { return dynamic_cast<AST::WhileNode *>(&child); })) {
+                std::vector<AST::NodePtr> copies;
+                copies.emplace_back(std::move(node.body));
+                for(std::size_t i = 1; i < options.unroll_factor; ++i)
+                    copies.emplace_back(copies.front()->clone());
+                node.body = std::make_unique<AST::BlockNode>(std::move(copies));
+                transformation.unrolled = options.unroll_factor;
+            }
+
+            if(!prologue.empty()) {
+                prologue.emplace_back(std::move(slot));
+                slot = std::make_unique<AST::IfNode>(std::move(guard), std::make_unique<AST::BlockNode>(
+                        std::move(prologue)), nullptr);
+            }
+            if(transformation.hoisted || transformation.reduced || transformation.unrolled
+               || transformation.vectorized)
+                transformations.push_back(std::move(transformation));
+        }
+
+        // The body accesses arrays without bounds checks and each iteration only writes the elements at the counter,
+        // reading no other elements of those arrays, so iterations don't depend on each other through memory.
+        // Calls, returns and inner loops would keep the C++ compiler from vectorizing it anyway.
+        static bool vectorizable(AST::WhileNode &loop, const Identifier &counter) {
+            std::unordered_set<Identifier> written;
+            bool accesses = false, blocked = false;
+            AST::for_each(*loop.body, [&](AST::Node &child) {
+                if(auto *assignment = dynamic_cast<AST::AssignmentNode *>(&child); assignment && assignment->element)
+                    written.insert(assignment->name);
+                else if(auto *element = dynamic_cast<AST::IndexNode *>(&child))
+                    accesses = true, blocked = blocked || element->checked;
+                else if(dynamic_cast<AST::FunctionCall *>(&child) || dynamic_cast<AST::ReturnNode *>(&child)
+                        || dynamic_cast<AST::WhileNode *>(&child))
+                    blocked = true;
+            });
+            return accesses && !blocked && !contains(*loop.body, [&](AST::Node &child) {
+                auto *element = dynamic_cast<AST::IndexNode *>(&child);
+                if(!element || !written.contains(element->array))
+                    return false;
+                auto *index = dynamic_cast<AST::IdentifierNode *>(element->index.get());
+                return !index || index->identifier != counter;
+            });
+        }
+
+        template<typename Start>
+        static std::optional<Counter> counted(AST::WhileNode &loop, const Variables &variables, Start &&start) {
+            auto *condition = dynamic_cast<AST::BinaryOpNode *>(loop.condition.get());
+            if(!condition || !is_relational(condition->op))
+                return std::nullopt;
+            auto *name = dynamic_cast<AST::IdentifierNode *>(condition->left.get());
+            auto *bound = dynamic_cast<AST::IntegerLiteralNode *>(condition->right.get());
+            auto *bound_variable = dynamic_cast<AST::IdentifierNode *>(condition->right.get());
+            if(!name || (!bound && (!bound_variable || assigns(*loop.body, bound_variable->identifier))))
+                return std::nullopt;
+
+            auto *body = dynamic_cast<AST::BlockNode *>(loop.body.get());
+            auto *last = body ? (body->statements.empty() ? nullptr : body->statements.back().get()) : loop.body.get();
+            auto *update = dynamic_cast<AST::AssignmentNode *>(last);
+            if(!update || update->name != name->identifier)
+                return std::nullopt;
+            auto *step = dynamic_cast<AST::BinaryOpNode *>(update->expression.get());
+            if(!step || (step->op != Operator::Add && step->op != Operator::Subtract))
+                return std::nullopt;
+            auto *self = dynamic_cast<AST::IdentifierNode *>(step->left.get());
+            auto *amount = dynamic_cast<AST::IntegerLiteralNode *>(step->right.get());
+            if(!amount && step->op == Operator::Add) {
+                self = dynamic_cast<AST::IdentifierNode *>(step->right.get());
+                amount = dynamic_cast<AST::IntegerLiteralNode *>(step->left.get());
+            }
+            if(!self || !amount || self->identifier != name->identifier || amount->value == 0)
+                return std::nullopt;
+
+            std::size_t assignments = 0;
+            AST::for_each(*loop.body, [&](AST::Node &child) {
+                auto *assignment = dynamic_cast<AST::AssignmentNode *>(&child);
+                assignments += assignment && assignment->name == name->identifier;
+            });
+            if(assignments != 1)
+                return std::nullopt;
+
+            Counter counter{name->identifier, condition->op, bound ? std::optional<Wide>(bound->value) : std::nullopt,
+                            step->op == Operator::Add ? Wide(amount->value) : -Wide(amount->value), std::nullopt,
+                            std::nullopt};
+            const bool upwards = counter.comparison == Operator::LessThan || counter.comparison == Operator::LessThanOrEq;
+            if(upwards != (counter.step > 0))
+                return std::nullopt;
+
+            auto type = variables.find(counter.name);
+            if(type == variables.end())
+                return std::nullopt;
+            counter.start = start(counter.name);
+            if(!counter.start || !counter.bound || *counter.bound > Types::max(type->second))
+                return counter;
+
+            // Past the last iteration, the counter ends up beyond the bound
+            auto first = *counter.start, bound_value = *counter.bound;
+            Wide iterations;
+            switch(counter.comparison) {
+                case Operator::LessThan:
+                    iterations = first < bound_value ? (bound_value - first + counter.step - 1) / counter.step : 0;
+                    break;
+                case Operator::LessThanOrEq:
+                    iterations = first <= bound_value ? (bound_value - first) / counter.step + 1 : 0;
+                    break;
+                case Operator::GreaterThan:
+                    iterations = first > bound_value ? (first - bound_value - counter.step - 1) / -counter.step : 0;
+                    break;
+                default:
+                    iterations = first >= bound_value ? (first - bound_value) / -counter.step + 1 : 0;
+                    break;
+            }
+            // The counter would wrap around instead of reaching the bound
+            const auto end = first + iterations * counter.step;
+            if(std::min(first, end) < Types::min(type->second) || std::max(first, end) > Types::max(type->second))
+                return counter;
+            counter.iterations = iterations;
+            return counter;
+        }
+
+        // Every variable the loop assigns or declares
+        static std::unordered_set<Identifier> variant(AST::WhileNode &loop) {
+            std::unordered_set<Identifier> names;
+            AST::for_each(*loop.body, [&](AST::Node &child) {
+                if(auto *assignment = dynamic_cast<AST::AssignmentNode *>(&child))
+                    names.insert(assignment->name);
+                else if(auto *declaration = dynamic_cast<AST::DeclarationNode *>(&child))
+                    names.insert(declaration->name);
+            });
+            return names;
+        }
+
+        // Constant expressions are left to the C++ compiler
+        static bool is_invariant(AST::Node &expression, const std::unordered_set<Identifier> &variant) {
+            if(!dynamic_cast<AST::BinaryOpNode *>(&expression))
+                return false;
+            bool reads = false;
+            return !contains(expression, [&](AST::Node &child) {
+                if(auto *id = dynamic_cast<AST::IdentifierNode *>(&child)) {
+                    reads = true;
+                    return variant.contains(id->identifier);
+                }
+                if(auto *op = dynamic_cast<AST::BinaryOpNode *>(&child)) {
+                    if(op->op != Operator::Divide && op->op != Operator::Modulus)
+                        return false;
+                    auto *divisor = dynamic_cast<AST::IntegerLiteralNode *>(op->right.get());
+                    return !divisor || divisor->value == 0;
+                }
+                return !dynamic_cast<AST::IntegerLiteralNode *>(&child);
+            }) && reads;
+        }
+
+        // The largest invariant expressions that are evaluated whenever the expression is
+        static void invariants(AST::NodePtr &slot, const std::unordered_set<Identifier> &variant,
+                               std::vector<AST::NodePtr *> &found) {
+            if(is_invariant(*slot, variant)) {
+                found.push_back(&slot);
+            } else if(auto *op = dynamic_cast<AST::BinaryOpNode *>(slot.get())) {
+                invariants(op->left, variant, found);
+                if(op->op != Operator::LogicalAnd && op->op != Operator::LogicalOr)
+                    invariants(op->right, variant, found);
+            } else if(auto *conditional = dynamic_cast<AST::ConditionalNode *>(slot.get())) {
+                invariants(conditional->condition, variant, found);
+            } else if(auto *call = dynamic_cast<AST::FunctionCall *>(slot.get())) {
+                for(auto &argument : call->arguments)
+                    invariants(argument, variant, found);
+            } else if(auto *element = dynamic_cast<AST::IndexNode *>(slot.get())) {
+                invariants(element->index, variant, found);
+            }
+        }
+
+        // Collects the invariant expressions of the statements that run on every iteration, which ends at the
+        // first statement that could leave the iteration early or not finish it
+        static bool unconditional(AST::NodePtr &slot, const std::unordered_set<Identifier> &variant,
+                                  std::vector<AST::NodePtr *> &found) {
+            const auto leaves = contains(*slot, [](AST::Node &child) {
+                return dynamic_cast<AST::ReturnNode *>(&child) || dynamic_cast<AST::WhileNode *>(&child);
+            });
+            if(auto *block = dynamic_cast<AST::BlockNode *>(slot.get())) {
+                for(auto &statement : block->statements) {
+                    if(!unconditional(statement, variant, found))
+                        return false;
+                }
+            } else if(auto *branch = dynamic_cast<AST::IfNode *>(slot.get())) {
+                invariants(branch->expression, variant, found);
+                return !leaves;
+            } else if(leaves) {
+                return false;
+            } else if(auto *declaration = dynamic_cast<AST::DeclarationNode *>(slot.get())) {
+                invariants(declaration->expression, variant, found);
+            } else if(auto *assignment = dynamic_cast<AST::AssignmentNode *>(slot.get())) {
+                if(assignment->element)
+                    invariants(assignment->element, variant, found);
+                invariants(assignment->expression, variant, found);
+            } else {
+                invariants(slot, variant, found);
+            }
+            return true;
+        }
+
+        static void replace(AST::NodePtr &slot, const std::string &expression, const Identifier &name) {
+            if(dynamic_cast<AST::BinaryOpNode *>(slot.get()) && text(*slot) == expression) {
+                slot = identifier(name);
+                return;
+            }
+            for(auto *child : slot->children()) {
+                if(*child)
+                    replace(*child, expression, name);
+            }
+        }
+
+        std::size_t hoist(AST::WhileNode &loop, Variables &variables, std::vector<AST::NodePtr> &prologue) {
+            const auto names = variant(loop);
+            std::vector<AST::NodePtr *> found;
+            invariants(loop.condition, names, found);
+            unconditional(loop.body, names, found);
+
+            std::vector<std::pair<std::string, Identifier>> hoisted;
+            for(auto *slot : found) {
+                auto expression = text(**slot);
+                if(std::ranges::any_of(hoisted, [&](const auto &entry) { return entry.first == expression; }))
+                    continue;
+                auto name = "arj_inv" + std::to_string(temporaries++);
+                auto type = evaluated_type(**slot, variables);
+                prologue.emplace_back(std::make_unique<AST::DeclarationNode>(name, (*slot)->clone(), type));
+                variables[name] = type;
+                hoisted.emplace_back(std::move(expression), std::move(name));
+            }
+            for(const auto &[expression, name] : hoisted) {
+                replace(loop.condition, expression, name);
+                replace(loop.body, expression, name);
+            }
+            return hoisted.size();
+        }
+
+        // Whether counter * factor stays in type over every value the counter takes, including the one it
+        // ends with
+        static bool fits(const Counter &counter, IntegerType type, AST::Node &factor) {
+            auto *literal = dynamic_cast<AST::IntegerLiteralNode *>(&factor);
+            if(!counter.iterations || !literal)
+                return false;
+            const auto end = *counter.start + *counter.iterations * counter.step;
+            for(auto value : {*counter.start * Wide(literal->value), end * Wide(literal->value),
+                              counter.step * Wide(literal->value)}) {
+                if(value < Types::min(type) || value > Types::max(type))
+                    return false;
+            }
+            return true;
+        }
+
+        std::size_t strength_reduce(AST::WhileNode &loop, Counter &counter, Variables &variables,
+                                    std::vector<AST::NodePtr> &prologue) {
+            auto *body = dynamic_cast<AST::BlockNode *>(loop.body.get());
+            if(!body)
+                return 0;
+            const auto names = variant(loop);
+
+            // Every i * k and k * i, keyed by k
+            std::vector<std::pair<std::string, Identifier>> reduced;
+            std::vector<AST::NodePtr> updates;
+            std::function<void(AST::NodePtr &)> visit = [&](AST::NodePtr &slot) {
+                for(auto *child : slot->children()) {
+                    if(*child)
+                        visit(*child);
+                }
+                auto *product = dynamic_cast<AST::BinaryOpNode *>(slot.get());
+                if(!product || product->op != Operator::Multiply)
+                    return;
+                auto *factor = &product->right;
+                auto *id = dynamic_cast<AST::IdentifierNode *>(product->left.get());
+                if(!id || id->identifier != counter.name) {
+                    factor = &product->left;
+                    id = dynamic_cast<AST::IdentifierNode *>(product->right.get());
+                }
+                if(!id || id->identifier != counter.name)
+                    return;
+                auto *factor_id = dynamic_cast<AST::IdentifierNode *>(factor->get());
+                if(!dynamic_cast<AST::IntegerLiteralNode *>(factor->get())
+                   && (!factor_id || names.contains(factor_id->identifier)))
+                    return;
+
+                auto key = text(**factor);
+                auto it = std::ranges::find_if(reduced, [&](const auto &entry) { return entry.first == key; });
+                if(it == reduced.end()) {
+                    const auto type = evaluated_type(*product, variables);
+                    // Signed overflow is undefined, unsigned types wrap just like i * k would
+                    if(Types::min(type) != 0 && !fits(counter, type, **factor))
+                        return;
+                    const auto magnitude = static_cast<IntegerLiteral>(counter.step < 0 ? -counter.step : counter.step);
+                    AST::NodePtr increment;
+                    if(auto *literal = dynamic_cast<AST::IntegerLiteralNode *>(factor->get())) {
+                        increment = std::make_unique<AST::IntegerLiteralNode>(magnitude * literal->value);
+                    } else if(magnitude == 1) {
+                        increment = (*factor)->clone();
+                    } else {
+                        increment = binary(Operator::Multiply, std::make_unique<AST::IntegerLiteralNode>(magnitude),
+                                           (*factor)->clone());
+                        if(Types::min(evaluated_type(*increment, variables)) != 0)
+                            return;
+                    }
+                    auto name = "arj_iv" + std::to_string(temporaries++);
+                    prologue.emplace_back(std::make_unique<AST::DeclarationNode>(name, slot->clone(), type));
+                    variables[name] = type;
+                    updates.emplace_back(std::make_unique<AST::AssignmentNode>(name, binary(
+                            counter.step < 0 ? Operator::Subtract : Operator::Add, identifier(name),
+                            std::move(increment))));
+                    it = reduced.insert(reduced.end(), {std::move(key), std::move(name)});
+                }
+                slot = identifier(it->second);
+            };
+            // The last statement is the update of the counter, the reduced variables are updated right after it
+            for(std::size_t i = 0; i + 1 < body->statements.size(); ++i)
+                visit(body->statements[i]);
+            for(auto &update : updates)
+                body->statements.emplace_back(std::move(update));
+            return reduced.size();
+        }
+    };
+}
+
+LoopOptimizer &LoopOptimizer::run(std::vector<AST::FunctionNodePtr> &functions) {
+    for(auto &function : functions)
+        FunctionLoops(options, *function, transformations).run();
+    return *this;
+}
+
+void LoopOptimizer::print_report(std::ostream &out) const {
+    for(const auto &transformation : transformations) {
+        out << "loops: " << transformation.function << ": loop";
+        if(!transformation.counter.empty())
+            out << " over " << transformation.counter;
+        if(transformation.removed) {
+            out << " replaced by " << transformation.unrolled << " copies of its body\n";
+            continue;
+        }
+        out << ':';
+        if(transformation.hoisted)
+            out << ' ' << transformation.hoisted << " invariant expressions hoisted";
+        if(transformation.reduced)
+            out << (transformation.hoisted ? ", " : " ") << transformation.reduced << " multiplications reduced";
+        if(transformation.unrolled)
+            out << (transformation.hoisted || transformation.reduced ? ", " : " ") << "unrolled "
+                << transformation.unrolled << " times";
+        if(transformation.vectorized)
+            out << (transformation.hoisted || transformation.reduced ? ", " : " ") << "vectorized";
+        out << '\n';
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+#ifndef COMPILER_LOOPS_H
+#define COMPILER_LOOPS_H
+
+#include "ASTNode.h"
+#include <ostream>
+#include <vector>
+
+// Optimizes while loops, innermost first.
+// A loop is counted when its condition compares a variable i with a literal using <, <=, > or >=, and its body
+// ends with i = i + c or i = i - c for a literal c, moving i towards the bound, and assigns i nowhere else.
+// When i is also set to a literal right before the loop, the number of iterations is known.
+//  - Invariant expressions, which only read variables the loop doesn't assign, are evaluated once before it.
+//    Only expressions evaluated on every iteration are hoisted, and only those without calls or a division
+//    that could trap, so hoisting never evaluates something the loop wouldn't have.
+//  - In counted loops i * k, for an invariant k, becomes a variable that is incremented by c * k along with i.
+//    Unless its type wraps, the whole range of i has to be known to not overflow.
+//  - Loops with a small known number of iterations are replaced by copies of their body. Longer ones whose
+//    iteration count is a multiple of the unroll factor get that many copies per check of the condition.
+//  - Counted loops whose element accesses are all unchecked, that only write the elements at i and don't read
+//    any other elements of the arrays they write, are marked as having independent iterations. Those aren't
+//    unrolled, which would hide the pattern from the C++ compiler's vectorizer.
+// Hoisted and reduced values are declared in an if with the loop condition around the loop, so they are only
+// evaluated if the loop runs at least once.
+class LoopOptimizer {
+public:
+    struct Options {
+        bool hoist = true;
+        bool strength_reduce = true;
+        // Loops with at most this many iterations are unrolled completely
+        std::size_t max_unroll_iterations = 16;
+        // Unrolling stops once the copies of the body would be larger than this many nodes
+        std::size_t max_unrolled_size = 256;
+        std::size_t unroll_factor = 4;
+        // Mark loops over arrays whose iterations are independent for the C++ compiler to vectorize
+        bool vectorize = true;
+    };
+
+    struct Transformation {
+        Identifier function;
+        // The counter of a counted loop, empty otherwise
+        Identifier counter;
+        std::size_t hoisted = 0;
+        std::size_t reduced = 0;
+        // Copies of the body, 0 if the loop wasn't unrolled
+        std::size_t unrolled = 0;
+        bool removed = false;
+        bool vectorized = false;
+    };
+
+private:
+    Options options;
+    std::vector<Transformation> transformations;
+
+public:
+    LoopOptimizer() = default;
+
+    explicit LoopOptimizer(Options options) : options(options) {}
+
+    LoopOptimizer &run(std::vector<AST::FunctionNodePtr> &functions);
+
+    [[nodiscard]] const std::vector<Transformation> &report() const { return transformations; }
+
+    void print_report(std::ostream &) const;
+};
+
+#endif //COMPILER_LOOPS_H
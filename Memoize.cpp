@@ -0,0 +1,48 @@
+#include "Memoize.h"
+#include "CallGraph.h"
+#include "Effects.h"
+
+Memoizer &Memoizer::run(std::vector<AST::FunctionNodePtr> &functions) {
+    CallGraph graph(functions);
+    EffectAnalysis effects(functions);
+
+    for(auto &function : functions) {
+        const auto &name = function->name;
+        if(!function->memoize && !(options.automatic && graph.is_recursive(name)))
+            continue;
+
+        std::size_t recursive_calls = 0;
+        for(const auto &[callee, count] : graph.callees(name)) {
+            if(graph.same_component(name, callee))
+                recursive_calls += count;
+        }
+
+        std::string reason;
+        if(!effects.is_pure(name))
+            reason = "not pure, " + effects.reason(name);
+        else if(function->parameters.empty())
+            reason = "has no parameters";
+        else if(function->parameters.size() > options.max_parameters)
+            reason = "more than " + std::to_string(options.max_parameters) + " parameters";
+        else if(!function->memoize && recursive_calls < 2)
+            reason = "linear recursion, " + std::to_string(recursive_calls) + " recursive call site";
+
+        if(!reason.empty()) {
+            function->memoize = false;
+            decisions.push_back({name, false, std::move(reason)});
+            continue;
+        }
+        decisions.push_back({name, true, function->memoize
+                                         ? "marked memo"
+                                         : "pure with " + std::to_string(recursive_calls) + " recursive call sites"});
+        function->memoize = true;
+    }
+    return *this;
+}
+
+void Memoizer::print_report(std::ostream &out) const {
+    for(const auto &decision : decisions) {
+        out << "memoize: " << decision.function << ": " << (decision.memoized ? "memoized, " : "not memoized, ")
+            << decision.reason << '\n';
+    }
+}
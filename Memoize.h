@@ -0,0 +1,45 @@
+#pragma once
+#ifndef COMPILER_MEMOIZE_H
+#define COMPILER_MEMOIZE_H
+
+#include "ASTNode.h"
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Caches the results of pure recursive functions.
+// Functions marked with the memo keyword are memoized if they are pure. Without the keyword a pure function is
+// memoized if it calls itself (or its SCC) from more than one place, since that is where recomputing the same
+// arguments makes the running time exponential.
+class Memoizer {
+public:
+    struct Options {
+        // Choose functions without the memo keyword
+        bool automatic = true;
+        // Larger keys make the cache entries too big to be worth it
+        std::size_t max_parameters = 4;
+    };
+
+    struct Decision {
+        Identifier function;
+        bool memoized;
+        std::string reason;
+    };
+
+private:
+    Options options;
+    std::vector<Decision> decisions;
+
+public:
+    Memoizer() = default;
+
+    explicit Memoizer(Options options) : options(options) {}
+
+    Memoizer &run(std::vector<AST::FunctionNodePtr> &functions);
+
+    [[nodiscard]] const std::vector<Decision> &report() const { return decisions; }
+
+    void print_report(std::ostream &) const;
+};
+
+#endif //COMPILER_MEMOIZE_H
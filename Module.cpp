@@ -0,0 +1,409 @@
+#include "Module.h"
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace ModuleFormat;
+
+namespace {
+    struct Writer {
+        std::vector<ModuleFormat::Node> nodes;
+        std::vector<std::uint32_t> indices;
+        std::vector<String> strings;
+        std::string string_data;
+        std::unordered_map<std::string, std::uint32_t> interned;
+
+        std::uint32_t intern(const std::string &value) {
+            auto [it, inserted] = interned.try_emplace(value, static_cast<std::uint32_t>(strings.size()));
+            if(inserted) {
+                strings.push_back({static_cast<std::uint32_t>(string_data.size()), static_cast<std::uint32_t>(value.size())});
+                string_data += value;
+            }
+            return it->second;
+        }
+
+        // Children are written before their parent, so every reference points backwards
+        std::uint32_t add(const AST::Node &node) {
+            ModuleFormat::Node record{};
+            record.a = record.b = record.c = none;
+            if(auto *literal = dynamic_cast<const AST::IntegerLiteralNode *>(&node)) {
+                record.kind = Kind::IntegerLiteral;
+                record.value = literal->value;
+            } else if(auto *id = dynamic_cast<const AST::IdentifierNode *>(&node)) {
+                record.kind = Kind::Identifier;
+                record.a = intern(id->identifier);
+            } else if(auto *binary = dynamic_cast<const AST::BinaryOpNode *>(&node)) {
+                record.kind = Kind::BinaryOp;
+                record.op = static_cast<std::uint8_t>(binary->op);
+                record.a = add(*binary->left);
+                record.b = add(*binary->right);
+            } else if(auto *branch = dynamic_cast<const AST::IfNode *>(&node)) {
+                record.kind = Kind::If;
+                record.a = add(*branch->expression);
+                record.b = add(*branch->statement);
+                if(branch->elseStatement)
+                    record.c = add(*branch->elseStatement);
+            } else if(auto *conditional = dynamic_cast<const AST::ConditionalNode *>(&node)) {
+                record.kind = Kind::Conditional;
+                record.flags = conditional->branchless;
+                record.type = static_cast<std::uint8_t>(conditional->type);
+                record.a = add(*conditional->condition);
+                record.b = add(*conditional->then);
+                record.c = add(*conditional->otherwise);
+            } else if(auto *declaration = dynamic_cast<const AST::DeclarationNode *>(&node)) {
+                record.kind = Kind::Declaration;
+                record.a = intern(declaration->name);
+                record.b = add(*declaration->expression);
+                record.type = static_cast<std::uint8_t>(declaration->type);
+            } else if(auto *ret = dynamic_cast<const AST::ReturnNode *>(&node)) {
+                record.kind = Kind::Return;
+                record.a = add(*ret->expression);
+            } else if(auto *call = dynamic_cast<const AST::FunctionCall *>(&node)) {
+                record.kind = Kind::FunctionCall;
+                record.a = intern(call->identifier);
+                record.b = add_list(call->arguments);
+                record.c = static_cast<std::uint32_t>(call->arguments.size());
+            } else if(auto *block = dynamic_cast<const AST::BlockNode *>(&node)) {
+                record.kind = Kind::Block;
+                record.b = add_list(block->statements);
+                record.c = static_cast<std::uint32_t>(block->statements.size());
+            } else if(auto *loop = dynamic_cast<const AST::WhileNode *>(&node)) {
+                record.kind = Kind::While;
+                record.flags = loop->vectorize;
+                if(loop->condition)
+                    record.a = add(*loop->condition);
+                record.b = add(*loop->body);
+            } else if(auto *assignment = dynamic_cast<const AST::AssignmentNode *>(&node)) {
+                record.kind = Kind::Assignment;
+                record.a = intern(assignment->name);
+                record.b = add(*assignment->expression);
+                if(assignment->element)
+                    record.c = add(*assignment->element);
+            } else if(dynamic_cast<const AST::ContinueNode *>(&node)) {
+                record.kind = Kind::Continue;
+            } else if(auto *array = dynamic_cast<const AST::ArrayDeclarationNode *>(&node)) {
+                record.kind = Kind::ArrayDeclaration;
+                record.a = intern(array->name);
+                record.b = add(*array->size);
+                record.type = static_cast<std::uint8_t>(array->element_type);
+            } else if(auto *element = dynamic_cast<const AST::IndexNode *>(&node)) {
+                record.kind = Kind::Index;
+                record.flags = element->checked;
+                record.a = intern(element->array);
+                record.b = add(*element->index);
+            } else {
+                throw std::logic_error("Node can't be written to a module");
+            }
+            nodes.push_back(record);
+            return static_cast<std::uint32_t>(nodes.size() - 1);
+        }
+
+        std::uint32_t add_list(const std::vector<AST::NodePtr> &list) {
+            std::vector<std::uint32_t> ids;
+            ids.reserve(list.size());
+            for(const auto &node : list)
+                ids.push_back(add(*node));
+            auto first = static_cast<std::uint32_t>(indices.size());
+            indices.insert(indices.end(), ids.begin(), ids.end());
+            return first;
+        }
+    };
+
+    std::uint64_t align(std::uint64_t offset) {
+        return (offset + 7) & ~std::uint64_t(7);
+    }
+
+    template<typename T>
+    void write_section(std::ostream &out, std::uint64_t &position, std::uint64_t offset, const T *data, std::size_t count) {
+        static const char padding[8] = {};
+        out.write(padding, static_cast<std::streamsize>(offset - position));
+        out.write(reinterpret_cast<const char *>(data), static_cast<std::streamsize>(count * sizeof(T)));
+        position = offset + count * sizeof(T);
+    }
+
+    [[noreturn]] void invalid(const std::string &reason) {
+        throw std::runtime_error("Invalid module: " + reason);
+    }
+}
+
+void write_module(const std::vector<AST::FunctionNodePtr> &functions, std::ostream &out) {
+    Writer writer;
+    std::vector<Function> records;
+    records.reserve(functions.size());
+    for(const auto &function : functions) {
+        Function record{};
+        record.name = writer.intern(function->name);
+        std::vector<std::uint32_t> parameters;
+        for(const auto &parameter : function->parameters)
+            parameters.push_back(writer.intern(parameter));
+        for(auto type : function->parameter_types)
+            parameters.push_back(static_cast<std::uint32_t>(type));
+        record.first_parameter = static_cast<std::uint32_t>(writer.indices.size());
+        record.parameter_count = static_cast<std::uint32_t>(function->parameters.size());
+        writer.indices.insert(writer.indices.end(), parameters.begin(), parameters.end());
+        record.first_statement = writer.add_list(function->statements);
+        record.statement_count = static_cast<std::uint32_t>(function->statements.size());
+        record.flags = (function->memoize ? memoize_flag : 0)
+                       | static_cast<std::uint32_t>(function->return_type) << return_type_shift;
+        records.push_back(record);
+    }
+
+    Header header{};
+    std::memcpy(header.magic, magic, sizeof(magic));
+    header.version = version;
+    header.function_count = static_cast<std::uint32_t>(records.size());
+    header.node_count = static_cast<std::uint32_t>(writer.nodes.size());
+    header.index_count = static_cast<std::uint32_t>(writer.indices.size());
+    header.string_count = static_cast<std::uint32_t>(writer.strings.size());
+    header.functions_offset = align(sizeof(Header));
+    header.nodes_offset = align(header.functions_offset + records.size() * sizeof(Function));
+    header.indices_offset = align(header.nodes_offset + writer.nodes.size() * sizeof(ModuleFormat::Node));
+    header.strings_offset = align(header.indices_offset + writer.indices.size() * sizeof(std::uint32_t));
+    header.string_data_offset = header.strings_offset + writer.strings.size() * sizeof(String);
+    header.size = header.string_data_offset + writer.string_data.size();
+
+    std::uint64_t position = 0;
+    write_section(out, position, 0, &header, 1);
+    write_section(out, position, header.functions_offset, records.data(), records.size());
+    write_section(out, position, header.nodes_offset, writer.nodes.data(), writer.nodes.size());
+    write_section(out, position, header.indices_offset, writer.indices.data(), writer.indices.size());
+    write_section(out, position, header.strings_offset, writer.strings.data(), writer.strings.size());
+    write_section(out, position, header.string_data_offset, writer.string_data.data(), writer.string_data.size());
+}
+
+Module::Module(const std::filesystem::path &path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+        throw std::runtime_error("Could not open module " + path.string());
+    struct stat info{};
+    if(::fstat(fd, &info) != 0 || info.st_size < static_cast<off_t>(sizeof(Header))) {
+        ::close(fd);
+        invalid("file is too small");
+    }
+    length = static_cast<std::size_t>(info.st_size);
+    void *mapping = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if(mapping == MAP_FAILED)
+        throw std::runtime_error("Could not map module " + path.string());
+    data = static_cast<const std::byte *>(mapping);
+
+    try {
+        header = reinterpret_cast<const Header *>(data);
+        if(std::memcmp(header->magic, magic, sizeof(magic)) != 0)
+            invalid("bad magic");
+        if(header->version != version)
+            invalid("version " + std::to_string(header->version) + ", expected " + std::to_string(version));
+        if(header->size != length)
+            invalid("size doesn't match the file");
+
+        auto section = [&](std::uint64_t offset, std::uint64_t count, std::size_t size) {
+            if(offset % 8 != 0 || offset > length || count > (length - offset) / size)
+                invalid("section out of bounds");
+            return data + offset;
+        };
+        function_records = {reinterpret_cast<const Function *>(
+                section(header->functions_offset, header->function_count, sizeof(Function))), header->function_count};
+        node_records = {reinterpret_cast<const ModuleFormat::Node *>(
+                section(header->nodes_offset, header->node_count, sizeof(ModuleFormat::Node))), header->node_count};
+        index_records = {reinterpret_cast<const std::uint32_t *>(
+                section(header->indices_offset, header->index_count, sizeof(std::uint32_t))), header->index_count};
+        string_records = {reinterpret_cast<const String *>(
+                section(header->strings_offset, header->string_count, sizeof(String))), header->string_count};
+        if(header->string_data_offset > length)
+            invalid("string data out of bounds");
+        string_data = reinterpret_cast<const char *>(data + header->string_data_offset);
+
+        validate();
+    } catch(...) {
+        ::munmap(const_cast<std::byte *>(data), length);
+        throw;
+    }
+}
+
+Module::~Module() {
+    ::munmap(const_cast<std::byte *>(data), length);
+}
+
+// Checks every reference once up front, so the accessors and to_ast don't need to.
+// Children must come before their parent, which also rules out cycles.
+void Module::validate() const {
+    const auto string_bytes = length - header->string_data_offset;
+    for(const auto &string : string_records) {
+        if(string.offset > string_bytes || string.length > string_bytes - string.offset)
+            invalid("string out of bounds");
+    }
+    auto check_string = [&](std::uint32_t index) {
+        if(index >= string_records.size())
+            invalid("string reference out of bounds");
+    };
+    auto check_range = [&](std::uint32_t first, std::uint64_t count) {
+        if(first > index_records.size() || count > index_records.size() - first)
+            invalid("index range out of bounds");
+    };
+    auto check_type = [&](std::uint32_t type) {
+        if(type > static_cast<std::uint32_t>(IntegerType::U64))
+            invalid("unknown type");
+    };
+
+    for(std::uint32_t i = 0; i < node_records.size(); ++i) {
+        const auto &node = node_records[i];
+        auto check_child = [&](std::uint32_t child, bool optional = false) {
+            if((child != none || !optional) && child >= i)
+                invalid("node " + std::to_string(i) + " has a bad child");
+        };
+        switch(node.kind) {
+            case Kind::IntegerLiteral:
+            case Kind::Continue:
+                break;
+            case Kind::Identifier:
+                check_string(node.a);
+                break;
+            case Kind::BinaryOp:
+                if(node.op > static_cast<std::uint8_t>(Operator::LogicalNot))
+                    invalid("unknown operator");
+                check_child(node.a);
+                check_child(node.b);
+                break;
+            case Kind::If:
+                check_child(node.a);
+                check_child(node.b);
+                check_child(node.c, true);
+                break;
+            case Kind::Conditional:
+                check_type(node.type);
+                check_child(node.a);
+                check_child(node.b);
+                check_child(node.c);
+                break;
+            case Kind::Declaration:
+            case Kind::ArrayDeclaration:
+                check_type(node.type);
+                [[fallthrough]];
+            case Kind::Index:
+                check_string(node.a);
+                check_child(node.b);
+                break;
+            case Kind::Assignment:
+                check_string(node.a);
+                check_child(node.b);
+                check_child(node.c, true);
+                if(node.c != none && node_records[node.c].kind != Kind::Index)
+                    invalid("node " + std::to_string(i) + " assigns to something other than an element");
+                break;
+            case Kind::Return:
+                check_child(node.a);
+                break;
+            case Kind::FunctionCall:
+                check_string(node.a);
+                [[fallthrough]];
+            case Kind::Block:
+                check_range(node.b, node.c);
+                for(auto child : indices(node.b, node.c))
+                    check_child(child);
+                break;
+            case Kind::While:
+                check_child(node.a, true);
+                check_child(node.b);
+                break;
+            default:
+                invalid("unknown node kind");
+        }
+    }
+
+    for(const auto &function : function_records) {
+        check_string(function.name);
+        check_range(function.first_parameter, std::uint64_t(function.parameter_count) * 2);
+        for(auto parameter : indices(function.first_parameter, function.parameter_count))
+            check_string(parameter);
+        for(auto type : indices(function.first_parameter + function.parameter_count, function.parameter_count))
+            check_type(type);
+        check_type(function.flags >> return_type_shift);
+        check_range(function.first_statement, function.statement_count);
+        for(auto statement : indices(function.first_statement, function.statement_count)) {
+            if(statement >= node_records.size())
+                invalid("statement out of bounds");
+        }
+    }
+}
+
+std::vector<AST::FunctionNodePtr> Module::to_ast() const {
+    std::vector<AST::FunctionNodePtr> ret;
+    ret.reserve(function_records.size());
+    for(const auto &record : function_records) {
+        std::vector<Identifier> parameters;
+        for(auto parameter : indices(record.first_parameter, record.parameter_count))
+            parameters.emplace_back(string(parameter));
+        std::vector<AST::NodePtr> statements;
+        for(auto statement : indices(record.first_statement, record.statement_count))
+            statements.emplace_back(to_ast(statement));
+        auto function = std::make_unique<AST::FunctionNode>(Identifier(string(record.name)), std::move(parameters),
+                                                            std::move(statements));
+        const auto types = indices(record.first_parameter + record.parameter_count, record.parameter_count);
+        for(std::size_t i = 0; i < types.size(); ++i)
+            function->parameter_types[i] = static_cast<IntegerType>(types[i]);
+        function->return_type = static_cast<IntegerType>(record.flags >> return_type_shift);
+        function->memoize = record.flags & memoize_flag;
+        ret.emplace_back(std::move(function));
+    }
+    return ret;
+}
+
+AST::NodePtr Module::to_ast(std::uint32_t index) const {
+    const auto &node = node_records[index];
+    auto list = [&] {
+        std::vector<AST::NodePtr> children;
+        for(auto child : indices(node.b, node.c))
+            children.emplace_back(to_ast(child));
+        return children;
+    };
+    switch(node.kind) {
+        case Kind::IntegerLiteral:
+            return std::make_unique<AST::IntegerLiteralNode>(node.value);
+        case Kind::Identifier:
+            return std::make_unique<AST::IdentifierNode>(Identifier(string(node.a)));
+        case Kind::BinaryOp:
+            return std::make_unique<AST::BinaryOpNode>(static_cast<Operator>(node.op), to_ast(node.a), to_ast(node.b));
+        case Kind::If:
+            return std::make_unique<AST::IfNode>(to_ast(node.a), to_ast(node.b),
+                                                 node.c == none ? nullptr : to_ast(node.c));
+        case Kind::Conditional: {
+            auto conditional = std::make_unique<AST::ConditionalNode>(to_ast(node.a), to_ast(node.b), to_ast(node.c));
+            conditional->branchless = node.flags;
+            conditional->type = static_cast<IntegerType>(node.type);
+            return conditional;
+        }
+        case Kind::Declaration:
+            return std::make_unique<AST::DeclarationNode>(Identifier(string(node.a)), to_ast(node.b),
+                                                          static_cast<IntegerType>(node.type));
+        case Kind::Return:
+            return std::make_unique<AST::ReturnNode>(to_ast(node.a));
+        case Kind::FunctionCall:
+            return std::make_unique<AST::FunctionCall>(Identifier(string(node.a)), list());
+        case Kind::Block:
+            return std::make_unique<AST::BlockNode>(list());
+        case Kind::While: {
+            auto loop = std::make_unique<AST::WhileNode>(node.a == none ? nullptr : to_ast(node.a), to_ast(node.b));
+            loop->vectorize = node.flags;
+            return loop;
+        }
+        case Kind::Assignment:
+            return std::make_unique<AST::AssignmentNode>(Identifier(string(node.a)), to_ast(node.b),
+                                                         node.c == none ? nullptr : to_ast(node.c));
+        case Kind::Continue:
+            return std::make_unique<AST::ContinueNode>();
+        case Kind::ArrayDeclaration:
+            return std::make_unique<AST::ArrayDeclarationNode>(Identifier(string(node.a)),
+                                                               static_cast<IntegerType>(node.type), to_ast(node.b));
+        case Kind::Index: {
+            auto element = std::make_unique<AST::IndexNode>(Identifier(string(node.a)), to_ast(node.b));
+            element->checked = node.flags;
+            return element;
+        }
+    }
+    invalid("unknown node kind");
+}
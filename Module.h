@@ -0,0 +1,131 @@
+#pragma once
+#ifndef COMPILER_MODULE_H
+#define COMPILER_MODULE_H
+
+#include "ASTNode.h"
+#include <cstdint>
+#include <filesystem>
+#include <ostream>
+#include <span>
+#include <string_view>
+#include <vector>
+
+// Binary format for a parsed program.
+// Every section is an array of fixed size records and every reference is an index into one of them, so the file
+// is position independent and can be used straight from an mmap without fix-ups or allocating per node.
+//
+// Layout: Header, Function[], Node[], std::uint32_t indices[], String[], string bytes.
+// Children lists and parameter lists are ranges in the indices section, parameter names are followed by their types.
+namespace ModuleFormat {
+    constexpr char magic[4] = {'A', 'R', 'J', 'M'};
+    constexpr std::uint32_t version = 3;
+    constexpr std::uint32_t none = 0xffffffff;
+
+    struct Header {
+        char magic[4];
+        std::uint32_t version;
+        std::uint32_t function_count;
+        std::uint32_t node_count;
+        std::uint32_t index_count;
+        std::uint32_t string_count;
+        std::uint64_t functions_offset;
+        std::uint64_t nodes_offset;
+        std::uint64_t indices_offset;
+        std::uint64_t strings_offset;
+        std::uint64_t string_data_offset;
+        std::uint64_t size;
+    };
+
+    enum class Kind : std::uint8_t {
+        IntegerLiteral, // value
+        Identifier,     // a: string
+        BinaryOp,       // op, a: left, b: right
+        If,             // a: expression, b: statement, c: else statement or none
+        Conditional,    // a: condition, b: then, c: otherwise, flags: branchless, type
+        Declaration,    // a: name string, b: expression, type
+        Return,         // a: expression
+        FunctionCall,   // a: name string, b: first index, c: argument count
+        Block,          // b: first index, c: statement count
+        While,          // a: condition or none, b: body, flags: vectorize
+        Assignment,     // a: name string, b: expression, c: element or none
+        Continue,
+        ArrayDeclaration, // a: name string, b: size, type: element type
+        Index,          // a: array name string, b: index, flags: checked
+    };
+
+    struct Node {
+        Kind kind;
+        std::uint8_t op;
+        std::uint8_t flags;
+        std::uint8_t type;      // IntegerType
+        std::uint32_t a, b, c;
+        std::uint64_t value;
+    };
+
+    struct Function {
+        std::uint32_t name;
+        std::uint32_t first_parameter; // Index of the first parameter name string in the indices, types follow
+        std::uint32_t parameter_count;
+        std::uint32_t first_statement; // Index of the first statement node in the indices
+        std::uint32_t statement_count;
+        std::uint32_t flags;    // Return type in bits 8 to 15
+    };
+
+    constexpr std::uint32_t memoize_flag = 1;
+    constexpr std::uint32_t return_type_shift = 8;
+
+    struct String {
+        std::uint32_t offset;
+        std::uint32_t length;
+    };
+
+    static_assert(sizeof(Header) % 8 == 0 && sizeof(Node) == 24 && sizeof(Function) == 24 && sizeof(String) == 8);
+}
+
+// Serializes the functions in a single walk over the tree
+void write_module(const std::vector<AST::FunctionNodePtr> &functions, std::ostream &out);
+
+// A module mapped into memory. The accessors read the records in place.
+class Module {
+    const std::byte *data = nullptr;
+    std::size_t length = 0;
+
+    const ModuleFormat::Header *header = nullptr;
+    std::span<const ModuleFormat::Function> function_records;
+    std::span<const ModuleFormat::Node> node_records;
+    std::span<const std::uint32_t> index_records;
+    std::span<const ModuleFormat::String> string_records;
+    const char *string_data = nullptr;
+
+public:
+    // Throws std::runtime_error if the file can't be mapped or isn't a valid module of this version
+    explicit Module(const std::filesystem::path &path);
+
+    Module(const Module &) = delete;
+
+    Module &operator=(const Module &) = delete;
+
+    ~Module();
+
+    [[nodiscard]] std::span<const ModuleFormat::Function> functions() const { return function_records; }
+
+    [[nodiscard]] const ModuleFormat::Node &node(std::uint32_t index) const { return node_records[index]; }
+
+    [[nodiscard]] std::span<const std::uint32_t> indices(std::uint32_t first, std::uint32_t count) const {
+        return index_records.subspan(first, count);
+    }
+
+    [[nodiscard]] std::string_view string(std::uint32_t index) const {
+        return {string_data + string_records[index].offset, string_records[index].length};
+    }
+
+    // Rebuilds the tree for the passes and the transpiler
+    [[nodiscard]] std::vector<AST::FunctionNodePtr> to_ast() const;
+
+private:
+    void validate() const;
+
+    [[nodiscard]] AST::NodePtr to_ast(std::uint32_t node) const;
+};
+
+#endif //COMPILER_MODULE_H
@@ -0,0 +1,28 @@
+#pragma once
+#ifndef COMPILER_PARALLEL_H
+#define COMPILER_PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// Calls task(i) for every i in [0, count) on up to jobs threads, handing out indices one at a time
+// so a few large inputs don't leave the other threads idle. task must not throw.
+template<typename F>
+void parallel_for(std::size_t count, std::size_t jobs, F &&task) {
+    jobs = std::clamp<std::size_t>(jobs, 1, std::max<std::size_t>(count, 1));
+    std::atomic<std::size_t> next = 0;
+    auto worker = [&] {
+        for (auto i = next++; i < count; i = next++)
+            task(i);
+    };
+    std::vector<std::jthread> threads;
+    threads.reserve(jobs - 1);
+    for (std::size_t i = 1; i < jobs; ++i)
+        threads.emplace_back(worker);
+    worker();
+}
+
+#endif //COMPILER_PARALLEL_H
@@ -3,65 +3,141 @@
 //
 
 #include "Parser.h"
+#include "Stats.h"
+#include "Types.h"
 
 Parser &Parser::parse_program() {
+    STATS_PHASE(Parse);
     consume_token();
+    while (is_current_token(Keyword::Import)) {
+        parse_import();
+    }
     while (!holds_alternative<EndToken>(currentToken)) {
         functions.emplace_back(std::move(parse_function()));
     }
-    if(!decl_funcs.contains("main"))
+    if(require_main && !decl_funcs.contains("main"))
         throw_syntax_error("There is no main declared");
-    if(decl_funcs["main"] != 0)
+    if(decl_funcs.contains("main") && !decl_funcs["main"].parameters.empty())
         throw_syntax_error("Main shouldn't have any arguments.");
 
     return *this;
 }
 
+// import name; declares every function the module exports
+void Parser::parse_import() {
+    expect_current_token(Keyword::Import, "Expected import keyword");
+    auto module = get_expected_or_throw<Identifier>("Expected module name after import");
+    if(!import_resolver)
+        throw_syntax_error("Imports are only supported when compiling modules");
+    expect_next_token(Punctuation::Semicolon, "Expected semicolon after import");
+
+    std::vector<std::pair<Identifier, Signature>> exported;
+    try {
+        exported = import_resolver(module);
+    } catch (const SyntaxErrorException &e) {
+        throw_syntax_error(e.what());
+    }
+    for(auto &[name, signature] : exported) {
+        if(declared_signature(name))
+            throw_syntax_error(name + " imported from " + module + " is already declared");
+        decl_funcs[name] = signature;
+        imported_functions.emplace_back(name, signature);
+    }
+    consume_token();
+}
 
-AST::DeclarationNodePtr Parser::parse_declaration() {
+std::optional<Signature> Parser::declared_signature(const Identifier &name) const {
+    STATS_COUNT(FunctionLookups);
+    if(auto it = decl_funcs.find(name); it != decl_funcs.end())
+        return it->second;
+    if(function_lookup)
+        return function_lookup(name);
+    return std::nullopt;
+}
+
+bool Parser::declared_variable(const Identifier &name) const {
+    STATS_COUNT(VariableLookups);
+    return decl_vars.contains(name);
+}
+
+
+AST::NodePtr Parser::parse_declaration() {
     expect_current_token(Keyword::Let, "Expected 'Let' keyword to declare variable");
 
     Identifier name = std::move(get_expected_or_throw<Identifier>("Expected function name"));
 
-    if(decl_funcs.contains(name) || decl_vars.contains(name))
+    if(declared_signature(name) || declared_variable(name))
         throw_syntax_error(name + " is already declared");
     decl_vars.insert(name);
 
-    expect_next_token(Operator::Assignment, "Expected assignment operator after variable declaration");
+    consume_token();
+    auto type = IntegerType::Int;
+    if(is_current_token(Punctuation::Colon)) {
+        consume_token();
+        // let name: [type; size];
+        if(is_current_token(Punctuation::OpenBracket)) {
+            consume_token();
+            auto element_type = parse_type();
+            expect_current_token(Punctuation::Semicolon, "Expected semicolon between the element type and the size");
+            consume_token();
+            auto size = parse_expression();
+            expect_current_token(Punctuation::CloseBracket, "Expected closing bracket after the array size");
+            consume_token();
+            expect_current_token(Punctuation::Semicolon, "Expected semicolon after array declaration");
+            return std::make_unique<AST::ArrayDeclarationNode>(std::move(name), element_type, std::move(size));
+        }
+        type = parse_type();
+    }
+    expect_current_token(Operator::Assignment, "Expected assignment operator after variable declaration");
 
     consume_token();
 
     auto expression = parse_expression();
 
     expect_current_token(Punctuation::Semicolon, "Expected semicolon after variable declaration");
-    return std::make_unique<AST::DeclarationNode>(std::move(name), std::move(expression));
+    return std::make_unique<AST::DeclarationNode>(std::move(name), std::move(expression), type);
 }
 
 AST::FunctionNodePtr Parser::parse_function() {
+    STATS_COUNT(ParseFunction);
+    const auto begin = lexer.getTokenOffset();
+    bool memoize = false;
+    if (is_current_token(Keyword::Memo)) {
+        memoize = true;
+        consume_token();
+    }
     expect_current_token(Keyword::Fn, "Expected the fn keyword to declare the function");
 
     Identifier name = std::move(get_expected_or_throw<Identifier>("Expected function name"));
 
-    if(decl_funcs.contains(name))
+    if(declared_signature(name))
         throw_syntax_error(name + " is already declared");
 
     consume_token();
 
-    auto parameterList = parse_parameter_list();
-
-    decl_funcs[name] = parameterList.size();
+    Signature signature;
+    auto parameterList = parse_parameter_list(signature.parameters);
 
     decl_vars.clear();
 
     for(const auto &parameter : parameterList) {
-        if(decl_vars.contains(parameter))
+        if(declared_variable(parameter))
             throw_syntax_error(parameter + " is already declared.");
         decl_vars.insert(parameter);
     }
 
     expect_current_token(Punctuation::CloseParen, "Expected closing parenthesis");
 
-    expect_next_token(Punctuation::OpenBrace, "Expected opening brace after function declaration");
+    consume_token();
+    if(is_current_token(Operator::RightArrow)) {
+        consume_token();
+        signature.result = parse_type();
+    }
+    if(name == "main" && signature.result != IntegerType::Int && signature.result != IntegerType::I32)
+        throw_syntax_error("Main has to return i32");
+    decl_funcs[name] = signature;
+
+    expect_current_token(Punctuation::OpenBrace, "Expected opening brace after function declaration");
 
     std::vector<AST::NodePtr> statements;
     consume_token();
@@ -73,12 +149,25 @@ AST::FunctionNodePtr Parser::parse_function() {
 
     if(statements.empty() || !dynamic_cast<AST::ReturnNode*>(statements.back().get()))
         throw_syntax_error(name + " doesn't end with a return statement");
-    consume_token(); // Close brace
 
-    return std::make_unique<AST::FunctionNode>(std::move(name), std::move(parameterList), std::move(statements));
+    auto function = std::make_unique<AST::FunctionNode>(std::move(name), std::move(parameterList), std::move(statements));
+    function->parameter_types = std::move(signature.parameters);
+    function->return_type = signature.result;
+    function->memoize = memoize;
+    try {
+        STATS_PHASE(Check);
+        TypeChecker([this](const Identifier &callee) { return declared_signature(callee); }).check(*function);
+    } catch (const SyntaxErrorException &e) {
+        throw_syntax_error(function->name + ": " + e.what());
+    }
+
+    function_spans.emplace_back(begin, lexer.getTokenOffset() + 1);
+    consume_token(); // Close brace
+    return function;
 }
 
 AST::NodePtr Parser::parse_statement(bool declaration_allowed) {
+    STATS_COUNT(ParseStatement);
     if (is_current_token(EndToken()))
         return {};
     // Figure out what the statement is through forward-looking method
@@ -92,14 +181,31 @@ AST::NodePtr Parser::parse_statement(bool declaration_allowed) {
         ret = parse_declaration();
     } else if (is_current_token(Keyword::Return)) {
         ret = parse_return_statement();
+    } else if (is_current_token(Keyword::While)) {
+        ret = parse_while_statement();
+    } else if (is_current_token(Keyword::For)) {
+        ret = parse_for_statement();
+    } else if (is_current_token(Punctuation::OpenBrace)) {
+        ret = parse_block();
+    } else if (std::holds_alternative<Identifier>(currentToken) && lexer.lookAhead(1) == Token(Operator::Assignment)) {
+        ret = parse_assignment();
     } else {
         ret = parse_expression();
+        // a[i] = e;
+        if (is_current_token(Operator::Assignment)) {
+            auto *element = dynamic_cast<AST::IndexNode *>(ret.get());
+            if (!element)
+                throw_syntax_error("Only variables and array elements can be assigned");
+            consume_token();
+            auto array = element->array;
+            ret = std::make_unique<AST::AssignmentNode>(std::move(array), parse_expression(), std::move(ret));
+        }
     }
     expect_current_token(Punctuation::Semicolon, "Expected semicolon after statement");
     return ret;
 }
 
-std::vector<Identifier> Parser::parse_parameter_list() {
+std::vector<Identifier> Parser::parse_parameter_list(std::vector<IntegerType> &types) {
     std::vector<Identifier> parameterList;
 
     expect_current_token(Punctuation::OpenParen, "Expected opening parenthesis");
@@ -110,6 +216,12 @@ std::vector<Identifier> Parser::parse_parameter_list() {
 
         consume_token(); // identifier
 
+        types.push_back(IntegerType::Int);
+        if(is_current_token(Punctuation::Colon)) {
+            consume_token();
+            types.back() = parse_type();
+        }
+
         if(is_current_token(Punctuation::CloseParen))
             break;
 
@@ -120,12 +232,23 @@ std::vector<Identifier> Parser::parse_parameter_list() {
     return parameterList;
 }
 
+IntegerType Parser::parse_type() {
+    const auto &name = check_expected_or_throw<Identifier>("Expected a type");
+    auto type = Types::parse(name);
+    if(!type)
+        throw_syntax_error("Unknown type " + name);
+    consume_token();
+    return *type;
+}
+
 AST::NodePtr Parser::parse_expression() {
+    STATS_COUNT(ParseExpression);
     return parse_or();
 }
 
 // Highest precedence: multiplication and division
 AST::NodePtr Parser::parse_multiplication_division() {
+    STATS_COUNT(ParseMultiplicative);
     auto left = parse_function_call_or_literal();
 
     while (is_current_token(Operator::Multiply) || is_current_token(Operator::Divide)) {
@@ -140,6 +263,7 @@ AST::NodePtr Parser::parse_multiplication_division() {
 
 // Next precedence: addition and subtraction
 AST::NodePtr Parser::parse_addition_subtraction() {
+    STATS_COUNT(ParseAdditive);
     auto left = parse_multiplication_division();
 
     while (is_current_token(Operator::Add) || is_current_token(Operator::Subtract)) {
@@ -154,6 +278,7 @@ AST::NodePtr Parser::parse_addition_subtraction() {
 
 // Handle function calls, literals, and variable references
 AST::NodePtr Parser::parse_function_call_or_literal() {
+    STATS_COUNT(ParsePrimary);
     if (std::holds_alternative<IntegerLiteral>(currentToken)) {
         auto literal = std::get<IntegerLiteral>(currentToken);
         consume_token();
@@ -168,14 +293,22 @@ AST::NodePtr Parser::parse_function_call_or_literal() {
         consume_token();
         if (is_current_token(Punctuation::OpenParen)) {
             return parse_function_call(std::move(id_node));
+        } else if (is_current_token(Punctuation::OpenBracket)) {
+            if(!declared_variable(id_node->identifier))
+                throw_syntax_error(id_node->identifier + " is not declared");
+            consume_token();
+            auto index = parse_expression();
+            expect_current_token(Punctuation::CloseBracket, "Expected closing bracket after the index");
+            consume_token();
+            return std::make_unique<AST::IndexNode>(std::move(id_node->identifier), std::move(index));
         } else {
-            if(!decl_vars.contains(id_node->identifier))
+            if(!declared_variable(id_node->identifier))
                 throw_syntax_error(id_node->identifier + " is not declared");
             return id_node;
         }
     }
     else if (is_current_token(Keyword::If)) {
-        return parse_if_statement();
+        return parse_if_expression();
     }
     else if (is_current_token(Punctuation::OpenParen)) {
         consume_token();
@@ -192,7 +325,8 @@ AST::NodePtr Parser::parse_function_call_or_literal() {
 }
 
 AST::FunctionCallPtr Parser::parse_function_call(AST::IdentifierNodePtr identifier) {
-    if(!decl_funcs.contains(identifier->identifier))
+    const auto signature = declared_signature(identifier->identifier);
+    if(!signature)
         throw_syntax_error(identifier->identifier + " is not declared");
     consume_token();
 
@@ -204,7 +338,7 @@ AST::FunctionCallPtr Parser::parse_function_call(AST::IdentifierNodePtr identifi
         }
     }
 
-    if(decl_funcs[identifier->identifier] != arguments.size())
+    if(signature->parameters.size() != arguments.size())
         throw_syntax_error("Argument count mismatch");
 
     consume_token();
@@ -219,22 +353,124 @@ AST::NodePtr Parser::parse_if_statement() {
     auto statement = parse_statement(false);
     AST::NodePtr elseStatement;
 
-    if (is_current_token(Keyword::Else)) {
-        consume_token();
+    // The statement ends with a semicolon, so the else comes after it: if (a) return 1; else return 2;
+    if (lexer.lookAhead(1) == Token(Keyword::Else)) {
+        consume_token(); // Semicolon
+        consume_token(); // Else
         elseStatement = parse_statement(false);
     }
     expect_current_token(Punctuation::Semicolon, "Expected semicolon after statement");
     return std::make_unique<AST::IfNode>(std::move(expression), std::move(statement), std::move(elseStatement));
 }
 
+// { statements; }, the variables declared inside go out of scope at the closing brace
+AST::BlockNodePtr Parser::parse_block() {
+    expect_current_token(Punctuation::OpenBrace, "Expected opening brace");
+    auto outer = decl_vars;
+    std::vector<AST::NodePtr> statements;
+    consume_token();
+    while (!is_current_token(Punctuation::CloseBrace)) {
+        statements.emplace_back(parse_statement());
+        expect_current_token(Punctuation::Semicolon, "Expected semicolon after statement");
+        consume_token();
+    }
+    consume_token(); // Close brace
+    decl_vars = std::move(outer);
+    return std::make_unique<AST::BlockNode>(std::move(statements));
+}
+
+AST::AssignmentNodePtr Parser::parse_assignment() {
+    auto name = std::move(check_expected_or_throw<Identifier>("Expected variable name"));
+    if(!declared_variable(name))
+        throw_syntax_error(name + " is not declared");
+    expect_next_token(Operator::Assignment, "Expected assignment operator");
+    consume_token();
+    return std::make_unique<AST::AssignmentNode>(std::move(name), parse_expression());
+}
+
+// while (i < n) statement;
+AST::WhileNodePtr Parser::parse_while_statement() {
+    expect_current_token(Keyword::While, "Expected while keyword");
+    consume_token();
+    auto condition = parse_expression();
+    auto body = parse_statement(false);
+    return std::make_unique<AST::WhileNode>(std::move(condition), std::move(body));
+}
+
+// for (let i = 0; i < n; i = i + 1) statement; is a while loop with the update at the end of the body,
+// in a block of its own so i goes out of scope after the loop
+AST::BlockNodePtr Parser::parse_for_statement() {
+    expect_current_token(Keyword::For, "Expected for keyword");
+    expect_next_token(Punctuation::OpenParen, "Expected opening parenthesis after for");
+    auto outer = decl_vars;
+    consume_token();
+    std::vector<AST::NodePtr> statements;
+    statements.emplace_back(parse_declaration());
+    consume_token(); // Semicolon
+    auto condition = parse_expression();
+    expect_current_token(Punctuation::Semicolon, "Expected semicolon after the loop condition");
+    consume_token();
+    auto update = parse_assignment();
+    expect_current_token(Punctuation::CloseParen, "Expected closing parenthesis after the loop update");
+    consume_token();
+
+    std::vector<AST::NodePtr> body;
+    body.emplace_back(parse_statement(false));
+    body.emplace_back(std::move(update));
+    statements.emplace_back(std::make_unique<AST::WhileNode>(
+            std::move(condition), std::make_unique<AST::BlockNode>(std::move(body))));
+    decl_vars = std::move(outer);
+    return std::make_unique<AST::BlockNode>(std::move(statements));
+}
+
+// An if used as a value, both arms are expressions and the else is required: if (a < b) a else b
+AST::NodePtr Parser::parse_if_expression() {
+    expect_current_token(Keyword::If, "Expected if keyword");
+    consume_token();
+    auto condition = parse_expression();
+    auto then = parse_expression();
+    expect_current_token(Keyword::Else, "Expected else, an if used as a value needs both arms");
+    consume_token();
+    auto otherwise = parse_expression();
+    return std::make_unique<AST::ConditionalNode>(std::move(condition), std::move(then), std::move(otherwise));
+}
+
 void Parser::transpile(std::ostream &out) {
-    out << "#include <iostream>\n";
-    out << "int print(int x) {std::cout << x << std::endl; return 0; }\n";
+    transpile_functions(out, functions, imported_functions);
+}
+
+void Parser::transpile_functions(std::ostream &out, const std::vector<AST::FunctionNodePtr> &functions,
+                                 const std::vector<std::pair<Identifier, Signature>> &imported_functions) {
+    transpile_prelude(out,
+                      std::ranges::any_of(functions, [](const auto &function) { return function->memoize; }),
+                      std::ranges::any_of(functions, [](const auto &function) { return AST::contains_select(*function); }),
+                      std::ranges::any_of(functions, [](const auto &function) { return AST::contains_array(*function); }));
+    // Defined by another module, resolved when the modules are linked
+    for(const auto &[name, signature] : imported_functions) {
+        out << Types::cpp_name(signature.result) << ' ' << name << '(';
+        for(std::size_t i = 0; i < signature.parameters.size(); ++i)
+            out << (i ? ", " : "") << Types::cpp_name(signature.parameters[i]);
+        out << ") noexcept;\n";
+    }
     for(const auto & function : functions) {
         function->transpile(out);
     }
 }
 
+void Parser::transpile_prelude(std::ostream &out, bool memo_cache, bool select, bool arrays) {
+    STATS_PHASE(Transpile);
+    STATS_WRITTEN(out);
+    out << "#include <cstdint>\n#include <iostream>\n";
+    // Unary plus so 8 bit types print as numbers rather than characters
+    out << "template<typename T>\nstatic int print(T x) noexcept {std::cout << +x << std::endl; return 0; }\n";
+    if (memo_cache)
+        transpile_memo_cache(out);
+    if (select)
+        transpile_select(out);
+    if (arrays)
+        transpile_arrays(out);
+}
+
 AST::ReturnNodePtr Parser::parse_return_statement() {
     expect_current_token(Keyword::Return, "Expected return keyword.");
     consume_token();
@@ -244,6 +480,7 @@ AST::ReturnNodePtr Parser::parse_return_statement() {
 }
 
 AST::NodePtr Parser::parse_or() {
+    STATS_COUNT(ParseOr);
     auto left = parse_and();
     while (is_current_token(Operator::LogicalOr)) {
         auto op = std::get<Operator>(currentToken);
@@ -255,6 +492,7 @@ AST::NodePtr Parser::parse_or() {
 }
 
 AST::NodePtr Parser::parse_and() {
+    STATS_COUNT(ParseAnd);
     auto left = parse_equality();
     while (is_current_token(Operator::LogicalAnd)) {
         auto op = std::get<Operator>(currentToken);
@@ -266,6 +504,7 @@ AST::NodePtr Parser::parse_and() {
 }
 
 AST::NodePtr Parser::parse_equality() {
+    STATS_COUNT(ParseEquality);
     auto left = parse_relational();
     while (is_current_token(Operator::Equal) || is_current_token(Operator::NotEqual)) {
         auto op = std::get<Operator>(currentToken);
@@ -277,6 +516,7 @@ AST::NodePtr Parser::parse_equality() {
 }
 
 AST::NodePtr Parser::parse_relational() {
+    STATS_COUNT(ParseRelational);
     auto left = parse_addition_subtraction();
     while (is_current_token(Operator::LessThan)
            || is_current_token(Operator::LessThanOrEq)
@@ -290,3 +530,63 @@ AST::NodePtr Parser::parse_relational() {
     return left;
 }
 
+
+// Direct-mapped cache used by memoized functions. A colliding entry is simply overwritten,
+// so the memory per function is fixed no matter how many distinct arguments it sees.
+void Parser::transpile_memo_cache(std::ostream &out) {
+    out << R"(#include <cstddef>
+#include <cstdint>
+#include <tuple>
+namespace arj {
+template<std::size_t Size, typename Result, typename... Args>
+class memo_cache {
+    static_assert((Size & (Size - 1)) == 0, "Size must be a power of two");
+    struct entry { std::tuple<Args...> key; Result value; bool valid; };
+    entry table[Size]{};
+public:
+    template<typename F>
+    Result lookup(F &&compute, Args... args) {
+        std::uint64_t hash = 0x9e3779b97f4a7c15ull;
+        ((hash = (hash ^ static_cast<std::uint64_t>(args)) * 0xbf58476d1ce4e5b9ull, hash ^= hash >> 31), ...);
+        auto &slot = table[hash & (Size - 1)];
+        if (slot.valid && slot.key == std::tuple<Args...>(args...))
+            return slot.value;
+        Result value = compute();
+        slot = {{args...}, value, true};
+        return value;
+    }
+};
+}
+)";
+}
+
+// Branch free selection for conditionals whose arms are cheap and safe to evaluate unconditionally
+void Parser::transpile_select(std::ostream &out) {
+    out << R"(#include <type_traits>
+namespace arj {
+template<typename T>
+inline T select(bool condition, T a, T b) noexcept {
+    using U = std::make_unsigned_t<T>;
+    return static_cast<T>(static_cast<U>(b) ^ ((static_cast<U>(a) ^ static_cast<U>(b)) & -static_cast<U>(condition)));
+}
+}
+)";
+}
+
+// Checked element access, used wherever an index isn't proven to be in bounds
+void Parser::transpile_arrays(std::ostream &out) {
+    out << R"(#include <array>
+#include <cstdlib>
+#include <vector>
+namespace arj {
+template<typename Array, typename Index>
+inline auto &at(Array &array, Index index) noexcept {
+    if (__builtin_expect(index < Index(0) || static_cast<std::uint64_t>(index) >= array.size(), 0)) {
+        std::cerr << "index " << +index << " out of bounds for an array of size " << array.size() << std::endl;
+        std::abort();
+    }
+    return array[static_cast<std::size_t>(index)];
+}
+}
+)";
+}
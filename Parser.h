@@ -13,18 +13,35 @@
 #include <sstream>
 #include <unordered_set>
 #include <unordered_map>
+#include <algorithm>
+#include <functional>
+#include <optional>
 
 class Parser {
+public:
+    // Returns every function a module exports, throws SyntaxErrorException if it is unknown
+    using ImportResolver = std::function<std::vector<std::pair<Identifier, Signature>>(const Identifier &module)>;
+    // Returns the signature of a function declared outside the parsed source, if there is one
+    using FunctionLookup = std::function<std::optional<Signature>(const Identifier &name)>;
+
+private:
     Lexer lexer;
     Token currentToken;
     std::vector<AST::FunctionNodePtr> functions;
 
-    std::unordered_map<Identifier, std::size_t> decl_funcs{
-            {Identifier("print"), 1},
+    std::unordered_map<Identifier, Signature> decl_funcs{
+            {Identifier("print"), Signature{IntegerType::Int, {IntegerType::Int}}},
     };
     std::unordered_set<Identifier> decl_vars;
 
-
+    ImportResolver import_resolver;
+    // Functions from other modules, declared extern in the output
+    std::vector<std::pair<Identifier, Signature>> imported_functions;
+    FunctionLookup function_lookup;
+    // A module that is part of a larger program doesn't need a main
+    bool require_main = true;
+    // Byte offsets of the first token of every function and of the end of its closing brace
+    std::vector<std::pair<std::size_t, std::size_t>> function_spans;
 
 public:
     Parser() = delete;
@@ -34,13 +51,60 @@ public:
 
     Parser &parse_program();
 
+    // Lexes on a separate thread while parsing, see Lexer::start_pipeline
+    Parser &pipeline_lexer() {
+        lexer.start_pipeline();
+        return *this;
+    }
+
+    // Enables import statements and makes main optional
+    Parser &set_import_resolver(ImportResolver resolver) {
+        import_resolver = std::move(resolver);
+        require_main = false;
+        return *this;
+    }
+
+    // Parses a fragment of a program, where the lookup knows the functions declared before it. Makes main optional.
+    Parser &set_function_lookup(FunctionLookup lookup) {
+        function_lookup = std::move(lookup);
+        require_main = false;
+        return *this;
+    }
+
+    [[nodiscard]] const std::vector<std::pair<std::size_t, std::size_t>> &get_function_spans() const {
+        return function_spans;
+    }
+
+    [[nodiscard]] const std::vector<std::pair<Identifier, Signature>> &get_imported_functions() const {
+        return imported_functions;
+    }
+
     void transpile(std::ostream&);
+
+    // The prelude followed by the functions, for functions that didn't come from a Parser
+    static void transpile_functions(std::ostream &, const std::vector<AST::FunctionNodePtr> &,
+                                    const std::vector<std::pair<Identifier, Signature>> &imported_functions = {});
+
+    // Includes and runtime support that go before the functions, the runtime parts are only emitted when used
+    static void transpile_prelude(std::ostream &, bool memo_cache, bool select, bool arrays);
+
+    std::vector<AST::FunctionNodePtr> &get_functions() { return functions; }
 private:
+    void parse_import();
+
+    [[nodiscard]] std::optional<Signature> declared_signature(const Identifier &name) const;
+
+    [[nodiscard]] bool declared_variable(const Identifier &name) const;
+
     AST::FunctionNodePtr parse_function();
 
-    std::vector<Identifier> parse_parameter_list();
+    std::vector<Identifier> parse_parameter_list(std::vector<IntegerType> &types);
+
+    // i8 ... u64
+    IntegerType parse_type();
 
-    AST::DeclarationNodePtr parse_declaration();
+    // A variable, or an array when the type is [type; size]
+    AST::NodePtr parse_declaration();
 
     AST::NodePtr parse_expression();
 
@@ -56,6 +120,16 @@ private:
 
     AST::NodePtr parse_if_statement();
 
+    AST::NodePtr parse_if_expression();
+
+    AST::BlockNodePtr parse_block();
+
+    AST::AssignmentNodePtr parse_assignment();
+
+    AST::WhileNodePtr parse_while_statement();
+
+    AST::BlockNodePtr parse_for_statement();
+
     AST::ReturnNodePtr parse_return_statement();
 
     AST::NodePtr parse_or();
@@ -66,6 +140,12 @@ private:
 
     AST::NodePtr parse_relational();
 
+    static void transpile_memo_cache(std::ostream &);
+
+    static void transpile_select(std::ostream &);
+
+    static void transpile_arrays(std::ostream &);
+
 
     template<typename T>
     void throw_syntax_error(T &&error_message) {
@@ -0,0 +1,204 @@
+#include "Profile.h"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+    constexpr std::string_view profile_magic = "arjprof1";
+
+    // The path as a C++ string literal
+    std::string quoted_path(const std::filesystem::path &path) {
+        std::string literal = "\"";
+        for(char c : path.string()) {
+            if(c == '"' || c == '\\')
+                literal += '\\';
+            if(c == '\n')
+                literal += "\\n";
+            else
+                literal += c;
+        }
+        return literal + '"';
+    }
+
+    // Calls visit for every if in the function that has a number
+    template<typename F>
+    void for_each_numbered_if(AST::FunctionNode &function, F &&visit) {
+        AST::for_each(function, [&](AST::Node &node) {
+            if(auto *branch = dynamic_cast<AST::IfNode *>(&node); branch && branch->profile_index)
+                visit(*branch);
+        });
+    }
+}
+
+Profile &Profile::load(const std::filesystem::path &path) {
+    std::ifstream in(path);
+    if(!in)
+        throw std::runtime_error(path.string() + ": cannot read profile");
+    std::string line;
+    if(!std::getline(in, line) || line != profile_magic)
+        throw std::runtime_error(path.string() + ": not a profile written by an instrumented program");
+    for(std::size_t number = 2; std::getline(in, line); ++number) {
+        std::istringstream fields(line);
+        std::string kind;
+        Identifier function;
+        fields >> kind >> function;
+        if(kind == "call") {
+            std::uint64_t count;
+            if(fields >> count) {
+                calls[function] += count;
+                continue;
+            }
+        } else if(kind == "branch") {
+            std::size_t index;
+            Branch branch;
+            if(fields >> index >> branch.taken >> branch.not_taken) {
+                auto &counts = branches[function];
+                if(counts.size() <= index)
+                    counts.resize(index + 1);
+                counts[index].taken += branch.taken;
+                counts[index].not_taken += branch.not_taken;
+                continue;
+            }
+        }
+        throw std::runtime_error(path.string() + ":" + std::to_string(number) + ": malformed profile line");
+    }
+    return *this;
+}
+
+Profile &Profile::apply(std::vector<AST::FunctionNodePtr> &functions) {
+    const auto hot_names = hot_functions();
+    for(auto &function : functions) {
+        if(hot_names.contains(function->name)) {
+            function->temperature = Temperature::Hot;
+            ++hot;
+        } else if(auto it = calls.find(function->name); it != calls.end() && it->second == 0) {
+            function->temperature = Temperature::Cold;
+            ++cold;
+        }
+
+        auto it = branches.find(function->name);
+        if(it == branches.end())
+            continue;
+        std::size_t ifs = 0;
+        for_each_numbered_if(*function, [&](AST::IfNode &branch) {
+            ifs = std::max(ifs, *branch.profile_index + 1);
+        });
+        if(it->second.size() > ifs) {
+            stale.push_back(function->name);
+            continue;
+        }
+        for_each_numbered_if(*function, [&](AST::IfNode &branch) {
+            if(*branch.profile_index >= it->second.size())
+                return;
+            const auto &counts = it->second[*branch.profile_index];
+            const auto samples = counts.taken + counts.not_taken;
+            if(samples < options.min_branch_samples)
+                return;
+            const auto ratio = static_cast<double>(counts.taken) / static_cast<double>(samples);
+            if(ratio >= options.likely_ratio) {
+                branch.likelihood = Likelihood::Likely;
+                ++likely;
+            } else if(ratio <= 1 - options.likely_ratio) {
+                branch.likelihood = Likelihood::Unlikely;
+                ++unlikely;
+            }
+        });
+    }
+    return *this;
+}
+
+std::unordered_set<Identifier> Profile::hot_functions() const {
+    std::vector<std::pair<std::uint64_t, Identifier>> counts;
+    std::uint64_t total = 0;
+    for(const auto &[name, count] : calls) {
+        counts.emplace_back(count, name);
+        total += count;
+    }
+    // Ties are broken by name, so the result doesn't depend on the order of the map
+    std::ranges::sort(counts, std::greater{});
+    std::unordered_set<Identifier> result;
+    std::uint64_t covered = 0;
+    for(const auto &[count, name] : counts) {
+        if(count == 0 || static_cast<double>(covered) >= options.hot_share * static_cast<double>(total))
+            break;
+        result.insert(name);
+        covered += count;
+    }
+    return result;
+}
+
+void Profile::print_report(std::ostream &out) const {
+    out << "profile: " << hot << " hot and " << cold << " cold functions, " << likely << " likely and " << unlikely
+        << " unlikely ifs\n";
+    for(const auto &function : stale)
+        out << "profile: " << function << " has changed since the profile was written, its ifs are ignored\n";
+}
+
+void Profile::number(std::vector<AST::FunctionNodePtr> &functions) {
+    for(auto &function : functions) {
+        std::size_t next = 0;
+        AST::for_each(*function, [&](AST::Node &node) {
+            if(auto *branch = dynamic_cast<AST::IfNode *>(&node))
+                branch->profile_index = next++;
+        });
+    }
+}
+
+void Profile::instrument(std::vector<AST::FunctionNodePtr> &functions) {
+    std::size_t next_branch = 0;
+    for(std::size_t i = 0; i < functions.size(); ++i) {
+        auto &function = *functions[i];
+        function.profile_slot = i;
+        function.effect = Effect::Impure;
+        for_each_numbered_if(function, [&](AST::IfNode &branch) { branch.profile_slot = next_branch++; });
+    }
+}
+
+void Profile::transpile_runtime(std::ostream &out, const std::vector<AST::FunctionNodePtr> &functions,
+                                const std::filesystem::path &path) {
+    std::vector<const AST::FunctionNode *> counted;
+    // The function and number of every branch counter
+    std::vector<std::pair<const Identifier *, std::size_t>> ifs;
+    for(const auto &function : functions) {
+        if(function->profile_slot) {
+            counted.resize(std::max(counted.size(), *function->profile_slot + 1));
+            counted[*function->profile_slot] = function.get();
+        }
+        for_each_numbered_if(*function, [&](AST::IfNode &branch) {
+            if(!branch.profile_slot)
+                return;
+            ifs.resize(std::max(ifs.size(), *branch.profile_slot + 1));
+            ifs[*branch.profile_slot] = {&function->name, *branch.profile_index};
+        });
+    }
+    // C++ has no arrays of size 0
+    const auto calls_size = std::max<std::size_t>(counted.size(), 1);
+    const auto branches_size = std::max<std::size_t>(ifs.size(), 1);
+
+    out << "#include <cstdint>\n#include <cstdio>\nnamespace arj::profile {\n"
+        << "inline std::uint64_t calls[" << calls_size << "];\n"
+        << "inline std::uint64_t branches[" << branches_size << "][2];\n"
+        << "inline bool branch(std::size_t slot, bool taken) noexcept {\n"
+           "++branches[slot][taken ? 0 : 1];\nreturn taken;\n}\n"
+        << "inline const char *const function_names[" << calls_size << "] = {";
+    for(const auto *function : counted)
+        out << '"' << (function ? function->name : Identifier()) << "\", ";
+    out << "};\ninline const char *const branch_functions[" << branches_size << "] = {";
+    for(const auto &[function, index] : ifs)
+        out << '"' << (function ? *function : Identifier()) << "\", ";
+    out << "};\ninline const std::size_t branch_numbers[" << branches_size << "] = {";
+    for(const auto &[function, index] : ifs)
+        out << index << ", ";
+    out << "};\n"
+        << "// Writes the counts when main returns\n"
+        << "struct writer {\n~writer() {\nstd::FILE *file = std::fopen(" << quoted_path(path) << ", \"w\");\n"
+        << "if (!file) {\nstd::perror(" << quoted_path(path) << ");\nreturn;\n}\n"
+        << "std::fputs(\"" << profile_magic << "\\n\", file);\n"
+        << "for (std::size_t i = 0; i < " << counted.size() << "; ++i)\n"
+           "std::fprintf(file, \"call %s %llu\\n\", function_names[i], static_cast<unsigned long long>(calls[i]));\n"
+        << "for (std::size_t i = 0; i < " << ifs.size() << "; ++i)\n"
+           "std::fprintf(file, \"branch %s %zu %llu %llu\\n\", branch_functions[i], branch_numbers[i], "
+           "static_cast<unsigned long long>(branches[i][0]), static_cast<unsigned long long>(branches[i][1]));\n"
+        << "std::fclose(file);\n}\n};\ninline writer write_at_exit;\n}\n";
+}
@@ -0,0 +1,73 @@
+#pragma once
+#ifndef COMPILER_PROFILE_H
+#define COMPILER_PROFILE_H
+
+#include "ASTNode.h"
+#include <cstdint>
+#include <filesystem>
+#include <ostream>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Profile guided optimization. A program compiled with --instrument=FILE counts the calls of every function and
+// which way every if went, and writes the counts to FILE when main returns. An if is known by its function and
+// its number among the ifs of the function as parsed, so the counts still match when the optimizations copy or
+// move it, as long as the source doesn't change.
+// A later compile with --profile-use=FILE reads them back. Ifs that went the same way often enough are emitted
+// with [[likely]] or [[unlikely]]. The functions that made most of the calls are [[gnu::hot]] and are inlined up
+// to a larger size, and functions that were never called are [[gnu::cold]].
+class Profile {
+public:
+    struct Options {
+        // The most called functions that together made this share of the calls are hot
+        double hot_share = 0.9;
+        // An if whose then branch was taken at least this often is likely, at most 1 - this often unlikely
+        double likely_ratio = 0.9;
+        // Ifs that ran fewer times are left alone
+        std::uint64_t min_branch_samples = 16;
+    };
+
+    struct Branch {
+        std::uint64_t taken = 0, not_taken = 0;
+    };
+
+private:
+    Options options;
+    std::unordered_map<Identifier, std::uint64_t> calls;
+    // By the number of the if in its function
+    std::unordered_map<Identifier, std::vector<Branch>> branches;
+
+    std::size_t likely = 0, unlikely = 0, hot = 0, cold = 0;
+    // Functions with more ifs in the profile than in the source, whose branch counts were ignored
+    std::vector<Identifier> stale;
+
+public:
+    Profile() = default;
+
+    explicit Profile(Options options) : options(options) {}
+
+    // Adds the counts in a file written by an instrumented program. Throws std::runtime_error if it can't be read
+    // or isn't a profile.
+    Profile &load(const std::filesystem::path &);
+
+    // Marks the ifs and functions the profile knows enough about. The ifs have to be numbered.
+    Profile &apply(std::vector<AST::FunctionNodePtr> &functions);
+
+    // The most called functions, that together made hot_share of the calls
+    [[nodiscard]] std::unordered_set<Identifier> hot_functions() const;
+
+    void print_report(std::ostream &) const;
+
+    // Numbers the ifs of every function in pre-order, before the optimizations change them
+    static void number(std::vector<AST::FunctionNodePtr> &functions);
+
+    // Gives every function and numbered if a counter. Their effects are dropped, since they now write memory.
+    static void instrument(std::vector<AST::FunctionNodePtr> &functions);
+
+    // The counters of the instrumented functions and the code that writes them to path, goes before the functions
+    static void transpile_runtime(std::ostream &, const std::vector<AST::FunctionNodePtr> &functions,
+                                  const std::filesystem::path &path);
+};
+
+#endif //COMPILER_PROFILE_H
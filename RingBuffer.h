@@ -0,0 +1,64 @@
+#pragma once
+#ifndef COMPILER_RINGBUFFER_H
+#define COMPILER_RINGBUFFER_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <utility>
+
+// Bounded lock-free queue between exactly one producer thread and one consumer thread.
+// The indices only grow and are reduced modulo the capacity, which is a power of two. Each side keeps its own
+// copy of the other's index and only reloads it when the queue looks full or empty, so the cache line with the
+// other index moves between cores about once per wrap instead of once per element.
+template<typename T, std::size_t Capacity>
+class RingBuffer {
+    static_assert(Capacity > 1 && (Capacity & (Capacity - 1)) == 0, "Capacity has to be a power of two");
+
+    // Not std::hardware_destructive_interference_size, whose value may differ between translation units
+    static constexpr std::size_t cache_line = 64;
+
+    struct alignas(cache_line) Producer {
+        std::atomic<std::size_t> tail = 0;
+        std::size_t head_cache = 0;
+    };
+
+    struct alignas(cache_line) Consumer {
+        std::atomic<std::size_t> head = 0;
+        std::size_t tail_cache = 0;
+    };
+
+    Producer producer;
+    Consumer consumer;
+    std::array<T, Capacity> slots;
+
+public:
+    // Producer only, false if the queue is full and the value wasn't moved from
+    bool try_push(T &value) {
+        const auto tail = producer.tail.load(std::memory_order_relaxed);
+        if(tail - producer.head_cache == Capacity) {
+            producer.head_cache = consumer.head.load(std::memory_order_acquire);
+            if(tail - producer.head_cache == Capacity)
+                return false;
+        }
+        slots[tail & (Capacity - 1)] = std::move(value);
+        producer.tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only, false if the queue is empty
+    bool try_pop(T &value) {
+        const auto head = consumer.head.load(std::memory_order_relaxed);
+        if(head == consumer.tail_cache) {
+            consumer.tail_cache = producer.tail.load(std::memory_order_acquire);
+            if(head == consumer.tail_cache)
+                return false;
+        }
+        value = std::move(slots[head & (Capacity - 1)]);
+        consumer.head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+#endif //COMPILER_RINGBUFFER_H
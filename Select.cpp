@@ -0,0 +1,35 @@
+#include "Select.h"
+
+SelectLowering &SelectLowering::run(std::vector<AST::FunctionNodePtr> &functions) {
+    for(auto &function : functions) {
+        AST::for_each(*function, [&](AST::Node &node) {
+            auto *conditional = dynamic_cast<AST::ConditionalNode *>(&node);
+            if(!conditional)
+                return;
+            conditional->branchless = is_speculatable(*conditional->then) && is_speculatable(*conditional->otherwise);
+            ++(conditional->branchless ? lowered : kept);
+        });
+    }
+    return *this;
+}
+
+bool SelectLowering::is_speculatable(AST::Node &arm) const {
+    if(AST::size(arm) > options.max_arm_size)
+        return false;
+    bool safe = true;
+    AST::for_each(arm, [&](AST::Node &node) {
+        if(dynamic_cast<AST::FunctionCall *>(&node) || dynamic_cast<AST::IndexNode *>(&node)) {
+            safe = false;
+        } else if(auto *binary = dynamic_cast<AST::BinaryOpNode *>(&node)) {
+            if(binary->op != Operator::Divide && binary->op != Operator::Modulus)
+                return;
+            auto *divisor = dynamic_cast<AST::IntegerLiteralNode *>(binary->right.get());
+            safe = safe && divisor && divisor->value != 0;
+        }
+    });
+    return safe;
+}
+
+void SelectLowering::print_report(std::ostream &out) const {
+    out << "select: " << lowered << " if expressions lowered to a select, " << kept << " kept as branches\n";
+}
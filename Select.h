@@ -0,0 +1,37 @@
+#pragma once
+#ifndef COMPILER_SELECT_H
+#define COMPILER_SELECT_H
+
+#include "ASTNode.h"
+#include <ostream>
+#include <vector>
+
+// Marks if expressions whose arms can be evaluated unconditionally, so they are emitted as a branch free select.
+// An arm qualifies if it is small, has no calls (which could have effects, be expensive or not terminate)
+// and can't trap, so no division or modulus by anything but a non zero literal and no array accesses, which may
+// only be in range when the condition holds.
+class SelectLowering {
+public:
+    struct Options {
+        // Largest arm, in nodes, that is worth evaluating when it isn't selected
+        std::size_t max_arm_size = 8;
+    };
+
+private:
+    Options options;
+    std::size_t lowered = 0, kept = 0;
+
+public:
+    SelectLowering() = default;
+
+    explicit SelectLowering(Options options) : options(options) {}
+
+    SelectLowering &run(std::vector<AST::FunctionNodePtr> &functions);
+
+    void print_report(std::ostream &) const;
+
+private:
+    [[nodiscard]] bool is_speculatable(AST::Node &arm) const;
+};
+
+#endif //COMPILER_SELECT_H
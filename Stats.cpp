@@ -0,0 +1,96 @@
+#include "Stats.h"
+#include <cstdlib>
+#include <iomanip>
+#include <new>
+#include <ostream>
+#include <string_view>
+#include <sys/resource.h>
+
+#ifdef COMPILER_STATS
+namespace {
+    constexpr std::array<std::string_view, std::size_t(Stats::Phase::Count)> phase_names{
+            "lex", "parse", "check", "inline", "bounds", "loops", "tail_calls", "memoize", "select", "effects",
+            "transpile"};
+
+    constexpr std::array<std::string_view, std::size_t(Stats::Counter::Count)> counter_names{
+            "tokens", "parse_function", "parse_statement", "parse_expression", "parse_or", "parse_and",
+            "parse_equality", "parse_relational", "parse_addition_subtraction", "parse_multiplication_division",
+            "parse_function_call_or_literal", "function_lookups", "variable_lookups", "functions_written",
+            "bytes_written"};
+
+    std::uint64_t peak_rss_bytes() {
+        rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+        // In KiB on Linux
+        return static_cast<std::uint64_t>(usage.ru_maxrss) * 1024;
+    }
+}
+
+// The array and nothrow forms go through this one. Aligned allocations aren't counted.
+void *operator new(std::size_t size) {
+    if(Stats::enabled) {
+        auto &allocations = Stats::detail::allocations;
+        ++allocations.count;
+        allocations.bytes += size;
+    }
+    if(auto *memory = std::malloc(size ? size : 1))
+        return memory;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void *memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+void Stats::print(std::ostream &out, bool json) {
+    const auto totals = Stats::totals();
+    const auto rss = peak_rss_bytes();
+    const auto allocations = totals.allocation_count;
+    const auto bytes = totals.allocated_bytes;
+    auto seconds = [&](std::size_t phase) { return static_cast<double>(totals.nanoseconds[phase]) / 1e9; };
+
+    if(json) {
+        out << "{\"phases\": {";
+        for(std::size_t i = 0; i < phase_names.size(); ++i) {
+            out << (i ? ", " : "") << '"' << phase_names[i] << "\": {\"seconds\": " << seconds(i)
+                << ", \"runs\": " << totals.runs[i] << '}';
+        }
+        out << "}, \"counters\": {";
+        for(std::size_t i = 0; i < counter_names.size(); ++i)
+            out << (i ? ", " : "") << '"' << counter_names[i] << "\": " << totals.counters[i];
+        out << "}, \"peak_rss_bytes\": " << rss << ", \"allocations\": " << allocations << ", \"allocated_bytes\": "
+            << bytes << "}\n";
+        return;
+    }
+
+    double total = 0;
+    for(std::size_t i = 0; i < phase_names.size(); ++i)
+        total += seconds(i);
+    const auto flags = out.flags();
+    out << std::fixed << std::setprecision(6);
+    out << std::left << std::setw(28) << "phase" << std::right << std::setw(10) << "seconds" << std::setw(7) << "%"
+        << std::setw(11) << "runs" << '\n';
+    for(std::size_t i = 0; i < phase_names.size(); ++i) {
+        if(!totals.runs[i])
+            continue;
+        out << std::left << std::setw(28) << phase_names[i] << std::right << std::setw(10) << seconds(i)
+            << std::setprecision(1) << std::setw(7) << (total > 0 ? 100 * seconds(i) / total : 0.0)
+            << std::setprecision(6) << std::setw(11) << totals.runs[i] << '\n';
+    }
+    out << std::left << std::setw(28) << "total" << std::right << std::setw(10) << total << "\n\n";
+    for(std::size_t i = 0; i < counter_names.size(); ++i)
+        out << std::left << std::setw(32) << counter_names[i] << std::right << std::setw(14) << totals.counters[i] << '\n';
+    out << std::left << std::setw(32) << "peak_rss_kib" << std::right << std::setw(14) << rss / 1024 << '\n'
+        << std::left << std::setw(32) << "allocations" << std::right << std::setw(14) << allocations << '\n'
+        << std::left << std::setw(32) << "allocated_bytes" << std::right << std::setw(14) << bytes << '\n';
+    out.flags(flags);
+}
+#else
+void Stats::print(std::ostream &out, bool) {
+    out << "statistics are not available, the compiler was built without COMPILER_STATS\n";
+}
+#endif
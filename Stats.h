@@ -0,0 +1,166 @@
+#pragma once
+#ifndef COMPILER_STATS_H
+#define COMPILER_STATS_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <utility>
+
+// Time spent in each phase of a compile and counts of the work done in it, for --time-report and --stats.
+// Code is instrumented with the STATS_ macros at the bottom, which expand to nothing unless COMPILER_STATS is
+// defined, so a build without it pays nothing. With it, counters are always kept, each an increment of a thread
+// local, and phases and allocations are only counted while enabled is set.
+// Every thread keeps its own numbers and adds them to the totals when it exits, so threads don't contend.
+namespace Stats {
+    enum class Phase {
+        Lex, Parse, Check, Inline, Bounds, Loops, TailCalls, Memoize, Select, Effects, Transpile, Count
+    };
+
+    enum class Counter {
+        Tokens,
+        // Calls of each level of the recursive descent
+        ParseFunction, ParseStatement, ParseExpression, ParseOr, ParseAnd, ParseEquality, ParseRelational,
+        ParseAdditive, ParseMultiplicative, ParsePrimary,
+        FunctionLookups, VariableLookups,
+        FunctionsWritten, BytesWritten,
+        Count
+    };
+
+    struct Totals {
+        std::array<std::uint64_t, std::size_t(Counter::Count)> counters{};
+        // Time spent in a phase itself, without the phases it ran, and the number of times it ran
+        std::array<std::int64_t, std::size_t(Phase::Count)> nanoseconds{};
+        std::array<std::uint64_t, std::size_t(Phase::Count)> runs{};
+        std::uint64_t allocation_count = 0, allocated_bytes = 0;
+
+        Totals &operator+=(const Totals &other) {
+            for(std::size_t i = 0; i < counters.size(); ++i)
+                counters[i] += other.counters[i];
+            allocation_count += other.allocation_count;
+            allocated_bytes += other.allocated_bytes;
+            for(std::size_t i = 0; i < nanoseconds.size(); ++i) {
+                nanoseconds[i] += other.nanoseconds[i];
+                runs[i] += other.runs[i];
+            }
+            return *this;
+        }
+    };
+
+    // Set before the compile starts, threads started after it see it
+    inline bool enabled = false;
+
+    namespace detail {
+        inline std::mutex mutex;
+        // Of the threads that have exited
+        inline Totals finished;
+
+        // Counted by operator new, which runs before Local is constructed and after it is destroyed. This has
+        // neither, so it is always there.
+        struct Allocations {
+            std::uint64_t count = 0, bytes = 0;
+        };
+
+        inline thread_local Allocations allocations;
+
+        struct Local : Totals {
+            // The innermost phase being timed on this thread
+            Phase active = Phase::Count;
+
+            ~Local() {
+                std::scoped_lock lock(mutex);
+                finished += *this;
+                // Later allocations on this thread are lost
+                finished.allocation_count += std::exchange(allocations.count, 0);
+                finished.allocated_bytes += std::exchange(allocations.bytes, 0);
+            }
+        };
+
+        inline thread_local Local local;
+    }
+
+    inline void count(Counter counter, std::uint64_t amount = 1) {
+        detail::local.counters[std::size_t(counter)] += amount;
+    }
+
+    // The threads that have exited and the calling one
+    inline Totals totals() {
+        std::scoped_lock lock(detail::mutex);
+        auto totals = detail::finished;
+        totals += detail::local;
+        totals.allocation_count += detail::allocations.count;
+        totals.allocated_bytes += detail::allocations.bytes;
+        return totals;
+    }
+
+    // Times a scope as part of a phase. The time is taken away from the phase it interrupts.
+    class Timer {
+        Phase phase = Phase::Count, interrupted = Phase::Count;
+        std::chrono::steady_clock::time_point start;
+
+    public:
+        explicit Timer(Phase phase) {
+            if(!enabled)
+                return;
+            this->phase = phase;
+            interrupted = std::exchange(detail::local.active, phase);
+            start = std::chrono::steady_clock::now();
+        }
+
+        Timer(const Timer &) = delete;
+
+        Timer &operator=(const Timer &) = delete;
+
+        ~Timer() {
+            if(phase == Phase::Count)
+                return;
+            const auto elapsed = std::chrono::nanoseconds(std::chrono::steady_clock::now() - start).count();
+            auto &local = detail::local;
+            local.nanoseconds[std::size_t(phase)] += elapsed;
+            ++local.runs[std::size_t(phase)];
+            if(interrupted != Phase::Count)
+                local.nanoseconds[std::size_t(interrupted)] -= elapsed;
+            local.active = interrupted;
+        }
+    };
+
+    // Counts what is written to a stream in a scope, if the stream can tell its position
+    class Written {
+        std::ostream &out;
+        std::ostream::pos_type start = -1;
+
+    public:
+        explicit Written(std::ostream &out) : out(out) {
+            if(enabled)
+                start = out.tellp();
+        }
+
+        Written(const Written &) = delete;
+
+        Written &operator=(const Written &) = delete;
+
+        ~Written() {
+            if(start != std::ostream::pos_type(-1))
+                count(Counter::BytesWritten, static_cast<std::uint64_t>(out.tellp() - start));
+        }
+    };
+
+    // The totals with peak RSS and allocation counts, as a table or as JSON
+    void print(std::ostream &, bool json);
+}
+
+#ifdef COMPILER_STATS
+#define STATS_CONCAT_(a, b) a##b
+#define STATS_CONCAT(a, b) STATS_CONCAT_(a, b)
+#define STATS_COUNT(counter) ::Stats::count(::Stats::Counter::counter)
+#define STATS_PHASE(phase) ::Stats::Timer STATS_CONCAT(stats_timer_, __LINE__)(::Stats::Phase::phase)
+#define STATS_WRITTEN(out) ::Stats::Written STATS_CONCAT(stats_written_, __LINE__)(out)
+#else
+#define STATS_COUNT(counter) ((void)0)
+#define STATS_PHASE(phase) ((void)0)
+#define STATS_WRITTEN(out) ((void)0)
+#endif
+
+#endif //COMPILER_STATS_H
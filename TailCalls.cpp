@@ -0,0 +1,206 @@
+#include "TailCalls.h"
+
+namespace {
+    // Identifiers in the source can't have an underscore, so generated names never collide with them
+    const Identifier accumulator = "arj_acc";
+
+    enum class Shape {
+        Base,       // return e, where e doesn't call the function
+        Tail,       // return f(...)
+        Accumulate, // return a op f(...) or return f(...) op a
+        Other,      // any other return that calls the function
+    };
+
+    struct Classified {
+        Shape shape;
+        Operator op = Operator::Add;
+        AST::FunctionCall *call = nullptr;
+        AST::NodePtr *operand = nullptr;
+    };
+
+    std::size_t count_calls(AST::Node &node, const Identifier &name) {
+        std::size_t calls = 0;
+        AST::for_each(node, [&](AST::Node &child) {
+            if(auto *call = dynamic_cast<AST::FunctionCall *>(&child); call && call->identifier == name)
+                ++calls;
+        });
+        return calls;
+    }
+
+    bool contains_call(AST::Node &node) {
+        bool found = false;
+        AST::for_each(node, [&](AST::Node &child) {
+            found = found || dynamic_cast<AST::FunctionCall *>(&child);
+        });
+        return found;
+    }
+
+    AST::FunctionCall *self_call(AST::Node *node, const Identifier &name) {
+        auto *call = dynamic_cast<AST::FunctionCall *>(node);
+        return call && call->identifier == name ? call : nullptr;
+    }
+
+    Classified classify(AST::ReturnNode &ret, const Identifier &name) {
+        auto &expression = ret.expression;
+        if(count_calls(*expression, name) == 0)
+            return {Shape::Base};
+        if(auto *call = self_call(expression.get(), name); call && count_calls(*call, name) == 1)
+            return {Shape::Tail, Operator::Add, call};
+
+        auto *binary = dynamic_cast<AST::BinaryOpNode *>(expression.get());
+        if(binary && (binary->op == Operator::Add || binary->op == Operator::Multiply)) {
+            // The operand is hoisted above the recursive step, which is only safe if it has no calls at all
+            for(auto [call_side, operand] : {std::pair{&binary->right, &binary->left},
+                                             std::pair{&binary->left, &binary->right}}) {
+                auto *call = self_call(call_side->get(), name);
+                if(call && count_calls(*call, name) == 1 && !contains_call(**operand))
+                    return {Shape::Accumulate, binary->op, call, operand};
+            }
+        }
+        return {Shape::Other};
+    }
+
+    // Calls visit for every return statement that ends the function, including those nested in if statements
+    template<typename F>
+    void for_each_return(AST::NodePtr &statement, F &&visit) {
+        if(auto *ret = dynamic_cast<AST::ReturnNode *>(statement.get())) {
+            visit(statement, *ret);
+        } else if(auto *branch = dynamic_cast<AST::IfNode *>(statement.get())) {
+            for_each_return(branch->statement, visit);
+            if(branch->elseStatement)
+                for_each_return(branch->elseStatement, visit);
+        } else if(auto *block = dynamic_cast<AST::BlockNode *>(statement.get())) {
+            for(auto &child : block->statements)
+                for_each_return(child, visit);
+        }
+    }
+
+    bool returns_in_loop(AST::FunctionNode &function) {
+        bool found = false;
+        AST::for_each(function, [&](AST::Node &node) {
+            if(auto *loop = dynamic_cast<AST::WhileNode *>(&node); loop && !found) {
+                AST::for_each(*loop->body, [&](AST::Node &child) {
+                    found = found || dynamic_cast<AST::ReturnNode *>(&child);
+                });
+            }
+        });
+        return found;
+    }
+
+    AST::NodePtr identity(Operator op) {
+        return std::make_unique<AST::IntegerLiteralNode>(op == Operator::Multiply ? 1 : 0);
+    }
+
+    AST::NodePtr combine(Operator op, AST::NodePtr value) {
+        return std::make_unique<AST::BinaryOpNode>(op, std::make_unique<AST::IdentifierNode>(accumulator),
+                                                   std::move(value));
+    }
+
+    // Assigns the call arguments to the parameters and jumps back to the top of the loop.
+    // Arguments are evaluated into temporaries first whenever more than one parameter changes,
+    // so every argument sees the values of the current iteration.
+    void jump(std::vector<AST::NodePtr> &block, AST::FunctionCall &call, const AST::FunctionNode &function) {
+        const auto &parameters = function.parameters;
+        std::vector<std::size_t> changed;
+        for(std::size_t i = 0; i < parameters.size(); ++i) {
+            auto *id = dynamic_cast<AST::IdentifierNode *>(call.arguments[i].get());
+            if(!id || id->identifier != parameters[i])
+                changed.push_back(i);
+        }
+        if(changed.size() == 1) {
+            auto i = changed.front();
+            block.emplace_back(std::make_unique<AST::AssignmentNode>(parameters[i], std::move(call.arguments[i])));
+        } else {
+            for(auto i : changed)
+                block.emplace_back(std::make_unique<AST::DeclarationNode>("arj_tail" + std::to_string(i),
+                                                                          std::move(call.arguments[i]),
+                                                                          function.parameter_types[i]));
+            for(auto i : changed)
+                block.emplace_back(std::make_unique<AST::AssignmentNode>(
+                        parameters[i], std::make_unique<AST::IdentifierNode>("arj_tail" + std::to_string(i))));
+        }
+        block.emplace_back(std::make_unique<AST::ContinueNode>());
+    }
+}
+
+TailCallOptimizer &TailCallOptimizer::run(std::vector<AST::FunctionNodePtr> &functions) {
+    for(auto &function : functions)
+        transform(*function);
+    return *this;
+}
+
+void TailCallOptimizer::transform(AST::FunctionNode &function) {
+    const auto &name = function.name;
+    auto total_calls = count_calls(function, name);
+    if(total_calls == 0 || returns_in_loop(function))
+        return;
+
+    std::size_t tail = 0, accumulate = 0, other = 0;
+    std::optional<Operator> op;
+    bool mixed_ops = false;
+    for(auto &statement : function.statements) {
+        for_each_return(statement, [&](AST::NodePtr &, AST::ReturnNode &ret) {
+            auto classified = classify(ret, name);
+            switch(classified.shape) {
+                case Shape::Tail:
+                    ++tail;
+                    break;
+                case Shape::Accumulate:
+                    ++accumulate;
+                    mixed_ops = mixed_ops || (op && *op != classified.op);
+                    op = classified.op;
+                    break;
+                case Shape::Other:
+                    ++other;
+                    break;
+                case Shape::Base:
+                    break;
+            }
+        });
+    }
+
+    // Self-calls outside of return statements count as ordinary recursion
+    bool use_accumulator = accumulate > 0 && !mixed_ops && other == 0 && tail + accumulate == total_calls;
+    if(tail == 0 && !use_accumulator)
+        return;
+
+    for(auto &statement : function.statements) {
+        for_each_return(statement, [&](AST::NodePtr &slot, AST::ReturnNode &ret) {
+            auto classified = classify(ret, name);
+            if(classified.shape == Shape::Base && use_accumulator) {
+                ret.expression = combine(*op, std::move(ret.expression));
+                return;
+            }
+            if(classified.shape != Shape::Tail && !(classified.shape == Shape::Accumulate && use_accumulator))
+                return;
+
+            std::vector<AST::NodePtr> block;
+            if(classified.shape == Shape::Accumulate)
+                block.emplace_back(std::make_unique<AST::AssignmentNode>(
+                        accumulator, combine(*op, std::move(*classified.operand))));
+            jump(block, *classified.call, function);
+            slot = std::make_unique<AST::BlockNode>(std::move(block));
+        });
+    }
+
+    std::vector<AST::NodePtr> body;
+    if(use_accumulator)
+        body.emplace_back(std::make_unique<AST::DeclarationNode>(accumulator, identity(*op), function.return_type));
+    body.emplace_back(std::make_unique<AST::WhileNode>(
+            nullptr, std::make_unique<AST::BlockNode>(std::move(function.statements))));
+    function.statements = std::move(body);
+
+    transformations.push_back({name, use_accumulator ? op : std::nullopt,
+                               use_accumulator ? tail + accumulate : tail});
+}
+
+void TailCallOptimizer::print_report(std::ostream &out) const {
+    for(const auto &transformation : transformations) {
+        out << "tail calls: " << transformation.function << ": " << transformation.call_sites
+            << " self-calls turned into a loop";
+        if(transformation.accumulator)
+            out << " with a " << (*transformation.accumulator == Operator::Multiply ? "'*'" : "'+'")
+                << " accumulator";
+        out << '\n';
+    }
+}
@@ -0,0 +1,38 @@
+#pragma once
+#ifndef COMPILER_TAILCALLS_H
+#define COMPILER_TAILCALLS_H
+
+#include "ASTNode.h"
+#include <optional>
+#include <ostream>
+#include <vector>
+
+// Turns self-recursive functions into loops.
+// A `return f(...)` inside f becomes a parameter update followed by a jump back to the top of the function.
+// If every self-call has the shape `return a + f(...)` (or `*`, on either side) the function additionally
+// gets an accumulator, so `return a + f(...)` becomes `acc = acc + a` and `return e` becomes `return acc + e`.
+// Functions that return from inside a loop are left alone, since the jump would only continue that loop.
+class TailCallOptimizer {
+public:
+    struct Transformation {
+        Identifier function;
+        // Set when an accumulator was introduced
+        std::optional<Operator> accumulator;
+        std::size_t call_sites;
+    };
+
+private:
+    std::vector<Transformation> transformations;
+
+public:
+    TailCallOptimizer &run(std::vector<AST::FunctionNodePtr> &functions);
+
+    [[nodiscard]] const std::vector<Transformation> &report() const { return transformations; }
+
+    void print_report(std::ostream &) const;
+
+private:
+    void transform(AST::FunctionNode &);
+};
+
+#endif //COMPILER_TAILCALLS_H
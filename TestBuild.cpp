@@ -0,0 +1,112 @@
+#define BOOST_TEST_MODULE BuildTest
+
+#include <boost/test/included/unit_test.hpp>
+#include "Build.h"
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+static std::filesystem::path temporary_directory(const std::string &name) {
+    auto path = std::filesystem::temp_directory_path() / ("arjon-compiler-test-" + name);
+    std::filesystem::remove_all(path);
+    std::filesystem::create_directories(path);
+    return path;
+}
+
+static std::filesystem::path write_source(const std::filesystem::path &directory, const std::string &name,
+                                          const std::string &source) {
+    auto path = directory / (name + ".arj");
+    std::ofstream(path) << source;
+    return path;
+}
+
+BOOST_AUTO_TEST_CASE(interface_round_trip) {
+    auto interface = Interface::scan("math", "import util; fn add(a: i64, b: i64) -> i64 { return a + b; }"
+                                             "memo fn fib(n) { if (n <= 1) return n; else return fib(n - 1) + fib(n - 2); return 0; }"
+                                             "fn zero() { return 0; }");
+    BOOST_REQUIRE_EQUAL(interface.imports.size(), 1);
+    BOOST_CHECK_EQUAL(interface.imports[0], "util");
+    BOOST_REQUIRE_EQUAL(interface.functions.size(), 3);
+    BOOST_CHECK(interface.functions[0].second == (Signature{IntegerType::I64, {IntegerType::I64, IntegerType::I64}}));
+    BOOST_CHECK(interface.functions[1].second == (Signature{IntegerType::Int, {IntegerType::Int}}));
+    BOOST_CHECK(interface.functions[2].second == Signature{});
+
+    std::stringstream file;
+    interface.write(file);
+    auto read = Interface::read(file);
+    BOOST_CHECK_EQUAL(read.module, "math");
+    BOOST_CHECK(read.imports == interface.imports);
+    BOOST_CHECK(read.functions == interface.functions);
+
+    std::istringstream corrupt("arji2\nmodule math\nfn add\n");
+    BOOST_CHECK_THROW(Interface::read(corrupt), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(separate_compilation) {
+    auto directory = temporary_directory("build");
+    auto math = write_source(directory, "math", "fn square(x) { return x * x; }");
+    auto app = write_source(directory, "app", "import math; fn main() { print(square(7)); return 0; }");
+
+    std::ostringstream diagnostics;
+    ProgramBuilder builder(CompileOptions{}, {directory / "out", {}, 2});
+    BOOST_CHECK(builder.build({math, app}, diagnostics));
+    BOOST_CHECK_EQUAL(diagnostics.str(), "");
+
+    std::ifstream in(directory / "out" / "app.cpp");
+    std::stringstream code;
+    code << in.rdbuf();
+    // Declared but not defined, and not inlined since only its interface is known
+    BOOST_CHECK(code.str().find("int square(int) noexcept;") != std::string::npos);
+    BOOST_CHECK(code.str().find("print(square((7)))") != std::string::npos);
+    BOOST_CHECK(std::filesystem::exists(directory / "out" / "math.arji"));
+
+    // math can now be used through its precompiled interface alone
+    std::ostringstream precompiled;
+    BOOST_CHECK(ProgramBuilder(CompileOptions{}, {directory / "app-out", directory / "out", 1})
+                        .build({app}, precompiled));
+
+    std::filesystem::remove_all(directory);
+}
+
+BOOST_AUTO_TEST_CASE(link_errors) {
+    auto directory = temporary_directory("link");
+    auto a = write_source(directory, "a", "fn twice(x) { return x + x; } fn main() { return 0; }");
+    auto b = write_source(directory, "b", "fn twice(x) { return 2 * x; }");
+    auto c = write_source(directory, "c", "import missing; fn f() { return 0; }");
+
+    std::ostringstream duplicate;
+    BOOST_CHECK(!ProgramBuilder(CompileOptions{}, {directory / "out", {}}).build({a, b}, duplicate));
+    BOOST_CHECK(duplicate.str().find("twice is defined in both a and b") != std::string::npos);
+
+    std::ostringstream unknown;
+    BOOST_CHECK(!ProgramBuilder(CompileOptions{}, {directory / "out", {}}).build({a, c}, unknown));
+    BOOST_CHECK(unknown.str().find("Unknown module missing") != std::string::npos);
+
+    std::filesystem::remove_all(directory);
+}
+
+BOOST_AUTO_TEST_CASE(batch_compile) {
+    auto directory = temporary_directory("batch");
+    std::filesystem::create_directories(directory / "nested");
+    write_source(directory, "one", "fn main() { print(1); return 0; }");
+    write_source(directory / "nested", "two", "fn main() { print(2); return 0; }");
+    auto bad = write_source(directory, "bad", "fn main() { return x; }");
+    std::ofstream(directory / "list.txt") << (directory / "nested" / "*.arj").string() << '\n';
+
+    std::ostringstream diagnostics;
+    std::vector<std::filesystem::path> paths;
+    BOOST_CHECK(BatchCompiler::expand({(directory / "o*.arj").string(), "@" + (directory / "list.txt").string(),
+                                       bad.string()}, paths, diagnostics));
+    BOOST_REQUIRE_EQUAL(paths.size(), 3);
+    BOOST_CHECK(!BatchCompiler::expand({(directory / "**" / "*.none").string()}, paths, diagnostics));
+
+    auto result = BatchCompiler(CompileOptions{}, {directory / "out", 2}).compile(paths, diagnostics);
+    BOOST_CHECK_EQUAL(result.compiled, 2);
+    BOOST_CHECK_EQUAL(result.failed, 1);
+    BOOST_CHECK(std::filesystem::exists(directory / "out" / "one.cpp"));
+    BOOST_CHECK(std::filesystem::exists(directory / "out" / "two.cpp"));
+    BOOST_CHECK(diagnostics.str().find("bad.arj: x is not declared") != std::string::npos);
+    BOOST_CHECK(diagnostics.str().find("batch: 2 compiled, 1 failed") != std::string::npos);
+
+    std::filesystem::remove_all(directory);
+}
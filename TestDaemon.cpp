@@ -0,0 +1,55 @@
+#define BOOST_TEST_MODULE DaemonTest
+
+#include <boost/test/included/unit_test.hpp>
+#include "Daemon.h"
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+BOOST_AUTO_TEST_CASE(serves_concurrent_clients) {
+    auto socket = std::filesystem::temp_directory_path() / "arjon-compiler-test.sock";
+    const std::string source = "fn square(x) { return x * x; } fn main() { print(square(7)); return 0; }";
+    std::ostringstream expected, ignored;
+    Compiler(CompileOptions{}).compile(source, expected, ignored);
+
+    CompileServer server({socket, 2});
+    std::ostringstream log;
+    std::jthread serving([&] { server.run(log); });
+
+    std::vector<Daemon::Response> responses(4);
+    {
+        std::vector<std::jthread> clients;
+        for (std::size_t i = 0; i < responses.size(); ++i) {
+            clients.emplace_back([&, i] {
+                responses[i] = Daemon::send(socket, {{"--select-report"}, i % 2 ? source : "fn main() { return x; }"});
+            });
+        }
+    }
+    for (std::size_t i = 0; i < responses.size(); ++i) {
+        // Like a direct compile, a syntax error goes to the output
+        BOOST_CHECK_EQUAL(responses[i].exit_code, 0);
+        if (i % 2) {
+            BOOST_CHECK_EQUAL(responses[i].output, expected.str());
+            BOOST_CHECK(responses[i].diagnostics.starts_with("select: "));
+        } else {
+            BOOST_CHECK_EQUAL(responses[i].output, "x is not declared. At line 1, pos. 22.\n");
+        }
+    }
+
+    // The profile can change between identical requests
+    auto profile = std::filesystem::temp_directory_path() / "arjon-compiler-test-daemon.prof";
+    const std::vector<std::string> profile_arguments{"--profile-use=" + profile.string(), "--profile-report"};
+    std::ofstream(profile) << "arjprof1\ncall main 1\n";
+    BOOST_CHECK(Daemon::send(socket, {profile_arguments, source}).diagnostics.starts_with("profile: 1 hot and 0 cold"));
+    std::ofstream(profile) << "arjprof1\ncall main 1\ncall square 0\n";
+    BOOST_CHECK(Daemon::send(socket, {profile_arguments, source}).diagnostics.starts_with("profile: 1 hot and 1 cold"));
+    std::filesystem::remove(profile);
+
+    auto unknown = Daemon::send(socket, {{"--no-such-option"}, source});
+    BOOST_CHECK_EQUAL(unknown.exit_code, 2);
+
+    Daemon::stop(socket);
+    serving.join();
+    BOOST_CHECK_EQUAL(log.str(), "");
+    BOOST_CHECK_THROW(Daemon::send(socket, {{}, source}), std::runtime_error);
+}
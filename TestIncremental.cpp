@@ -0,0 +1,78 @@
+#define BOOST_TEST_MODULE IncrementalTest
+
+#include <boost/test/included/unit_test.hpp>
+#include "Incremental.h"
+#include "Parser.h"
+#include <sstream>
+
+static const std::string program =
+        "fn square(x) { return x * x; }\n"
+        "fn cube(x) {\n"
+        "    return x * square(x);\n"
+        "}\n"
+        "// a comment between functions\n"
+        "fn main() { print(cube(3)); return 0; }\n";
+
+static std::string transpile(const std::vector<AST::FunctionNodePtr> &functions) {
+    std::ostringstream out;
+    for(const auto &function : functions)
+        function->transpile(out);
+    return out.str();
+}
+
+// The incremental result has to match parsing the edited source from scratch
+static void check_matches_full_parse(const IncrementalParser &incremental) {
+    Parser parser(std::istringstream{incremental.get_source()});
+    parser.parse_program();
+    BOOST_CHECK_EQUAL(transpile(incremental.get_functions()), transpile(parser.get_functions()));
+}
+
+BOOST_AUTO_TEST_CASE(reparses_only_the_edited_function) {
+    IncrementalParser incremental(program);
+    const auto *square = incremental.get_functions()[0].get();
+    const auto *main = incremental.get_functions()[2].get();
+
+    auto offset = program.find("x * square");
+    auto changes = incremental.apply({offset, 1, "(x + 1)"});
+    BOOST_CHECK(changes.changed == std::vector<Identifier>{"cube"});
+    BOOST_CHECK(changes.added.empty() && changes.removed.empty());
+    BOOST_CHECK_LT(changes.reparsed, incremental.get_source().size() / 2);
+    BOOST_CHECK_EQUAL(incremental.get_functions()[0].get(), square);
+    BOOST_CHECK_EQUAL(incremental.get_functions()[2].get(), main);
+    check_matches_full_parse(incremental);
+
+    // Later functions moved, and are found at their new position
+    changes = incremental.apply({incremental.get_source().find("cube(3)") + 5, 1, "4"});
+    BOOST_CHECK(changes.changed == std::vector<Identifier>{"main"});
+    check_matches_full_parse(incremental);
+
+    // Only layout and comments changed
+    changes = incremental.apply({incremental.get_source().find("comment"), 7, "note"});
+    BOOST_CHECK(changes.changed.empty());
+    changes = incremental.apply({incremental.get_source().find("{ return x * x"), 1, "{\n   "});
+    BOOST_CHECK(changes.changed.empty());
+    BOOST_CHECK_EQUAL(incremental.get_functions()[0].get(), square);
+    check_matches_full_parse(incremental);
+}
+
+BOOST_AUTO_TEST_CASE(signature_changes_and_errors) {
+    IncrementalParser incremental(program);
+
+    // Renaming a function affects its callers, so the whole program is checked
+    auto source = incremental.get_source();
+    BOOST_CHECK_THROW(incremental.apply({source.find("square"), 6, "sq"}), SyntaxErrorException);
+    // The source keeps the edit, fixing the call makes it valid again
+    auto changes = incremental.apply({incremental.get_source().find("square"), 6, "sq"});
+    BOOST_CHECK(changes.added == std::vector<Identifier>{"sq"});
+    BOOST_CHECK(changes.removed == std::vector<Identifier>{"square"});
+    BOOST_CHECK(changes.changed == std::vector<Identifier>{"cube"});
+    check_matches_full_parse(incremental);
+
+    // A comment that swallows the rest of the line, including the closing brace
+    BOOST_CHECK_THROW(incremental.apply({incremental.get_source().find("print"), 0, "//"}), SyntaxErrorException);
+    changes = incremental.apply({incremental.get_source().find("//print"), 2, ""});
+    BOOST_CHECK(changes.changed.empty());
+    check_matches_full_parse(incremental);
+
+    BOOST_CHECK_THROW(incremental.apply({incremental.get_source().size() + 1, 0, ""}), std::out_of_range);
+}
@@ -5,10 +5,12 @@
 
 #include <boost/test/included/unit_test.hpp>
 #include "Lexer.h"
+#include "Stats.h"
 #include <sstream>
+#include <thread>
 
 BOOST_AUTO_TEST_CASE(test_1) {
-    std::istringstream ss("Let a = 500;");
+    std::istringstream ss("let a = 500;");
     auto ptr = std::make_unique<std::istringstream>(std::move(ss));
     Lexer lexer(std::move(ptr));
 
@@ -39,4 +41,70 @@ BOOST_AUTO_TEST_CASE(test_2) {
 BOOST_AUTO_TEST_CASE(test_3) {
     BOOST_CHECK_THROW(Lexer(std::unique_ptr<std::istream>{}), std::invalid_argument);
     Lexer lex(std::ifstream{});
-}
\ No newline at end of file
+}
+BOOST_AUTO_TEST_CASE(test_look_ahead) {
+    Lexer lexer(std::istringstream("return 1; else"));
+
+    BOOST_CHECK(lexer.lookAhead(1) == Token(Keyword::Return));
+    BOOST_CHECK(lexer.lookAhead(4) == Token(Keyword::Else));
+    BOOST_CHECK(lexer.getNextToken() == Token(Keyword::Return));
+    BOOST_CHECK(lexer.lookAhead(2) == Token(Punctuation::Semicolon));
+    BOOST_CHECK(lexer.getNextToken() == Token(IntegerLiteral(1)));
+}
+
+BOOST_AUTO_TEST_CASE(test_pipeline) {
+    // More tokens than fit in the ring, so the lexer thread has to wait for the parser
+    std::string source;
+    for (int i = 0; i < 5000; ++i)
+        source += "let a" + std::to_string(i) + " = " + std::to_string(i) + ";\n";
+    Lexer direct{std::istringstream(source)};
+    Lexer pipelined{std::istringstream(source)};
+    pipelined.start_pipeline();
+    for (int i = 0; i < 25000; ++i) {
+        if (i % 7 == 0)
+            BOOST_REQUIRE(direct.lookAhead(3) == pipelined.lookAhead(3));
+        BOOST_REQUIRE(direct.getNextToken() == pipelined.getNextToken());
+        BOOST_REQUIRE_EQUAL(direct.getTokenOffset(), pipelined.getTokenOffset());
+    }
+    BOOST_CHECK(pipelined.getNextToken() == Token(EndToken()));
+    BOOST_CHECK(pipelined.getNextToken() == Token(EndToken()));
+
+    // Errors are reported at the same position, after the thread is stopped
+    auto position = [](bool pipeline) {
+        Lexer lexer{std::istringstream("let a = 1;\nlet b = @;")};
+        if (pipeline)
+            lexer.start_pipeline();
+        try {
+            while (lexer.getNextToken() != Token(EndToken())) {}
+        } catch (const SyntaxErrorException &e) {
+            return std::make_pair(e.getLine(), e.getPosition());
+        }
+        return std::make_pair(0u, 0u);
+    };
+    BOOST_CHECK(position(true) == position(false));
+    BOOST_CHECK(position(true) != std::make_pair(0u, 0u));
+
+    // Stopped while it is waiting for room in the ring
+    Lexer abandoned{std::istringstream(source)};
+    abandoned.start_pipeline();
+    BOOST_CHECK(abandoned.getNextToken() == Token(Keyword::Let));
+}
+
+#ifdef COMPILER_STATS
+BOOST_AUTO_TEST_CASE(test_stats) {
+    Stats::enabled = true;
+    const auto before = Stats::totals();
+    Lexer lexer(std::istringstream("let a = 500; // comment\nreturn a;"));
+    while (lexer.getNextToken() != Token(EndToken())) {}
+    // Added to the totals when the thread exits
+    std::thread([] { Stats::count(Stats::Counter::Tokens, 10); }).join();
+    const auto after = Stats::totals();
+    Stats::enabled = false;
+
+    const auto tokens = std::size_t(Stats::Counter::Tokens), lex = std::size_t(Stats::Phase::Lex);
+    BOOST_CHECK_EQUAL(after.counters[tokens] - before.counters[tokens], 9u + 10u);
+    // The comment is skipped by a nested call
+    BOOST_CHECK_EQUAL(after.runs[lex] - before.runs[lex], 10u);
+    BOOST_CHECK(after.nanoseconds[lex] >= before.nanoseconds[lex]);
+}
+#endif
@@ -0,0 +1,76 @@
+#define BOOST_TEST_MODULE ModuleTest
+
+#include <boost/test/included/unit_test.hpp>
+#include "Parser.h"
+#include "Module.h"
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+static std::filesystem::path temporary_module(const std::string &name) {
+    return std::filesystem::temp_directory_path() / ("arjon-compiler-test-" + name + ".arjm");
+}
+
+BOOST_AUTO_TEST_CASE(round_trip) {
+    Parser parser(std::istringstream(
+            "memo fn fib(n: u8) -> u64 { if (n <= 1) return n; else return fib(n - 1) + fib(n - 2); return 0; }"
+            "fn main() {"
+            "    let n: u8 = if (1 < 2) 9 else 3;"
+            "    let a: [u64; n];"
+            "    for (let i = 0; i < 4; i = i + 1) a[i] = fib(n);"
+            "    print(a[3]);"
+            "    return 0;"
+            "}"));
+    parser.parse_program();
+
+    auto path = temporary_module("round-trip");
+    {
+        std::ofstream out(path, std::ios::binary);
+        write_module(parser.get_functions(), out);
+    }
+
+    Module module(path);
+    BOOST_REQUIRE_EQUAL(module.functions().size(), 2);
+    BOOST_CHECK_EQUAL(module.string(module.functions()[0].name), "fib");
+    BOOST_CHECK(module.functions()[0].flags & ModuleFormat::memoize_flag);
+
+    std::ostringstream expected, actual;
+    parser.transpile(expected);
+    Parser::transpile_functions(actual, module.to_ast());
+    BOOST_CHECK_EQUAL(expected.str(), actual.str());
+
+    std::filesystem::remove(path);
+}
+
+BOOST_AUTO_TEST_CASE(rejects_corrupt_modules) {
+    Parser parser(std::istringstream("fn main() { return 1 + 2; }"));
+    parser.parse_program();
+
+    std::ostringstream out;
+    write_module(parser.get_functions(), out);
+    auto bytes = out.str();
+
+    auto path = temporary_module("corrupt");
+    auto write = [&](const std::string &contents) {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file << contents;
+    };
+
+    write(bytes.substr(0, bytes.size() - 1));
+    BOOST_CHECK_THROW(Module{path}, std::runtime_error);
+
+    auto wrong_version = bytes;
+    wrong_version[4] = 99;
+    write(wrong_version);
+    BOOST_CHECK_THROW(Module{path}, std::runtime_error);
+
+    // Make the return statement point at itself
+    auto cycle = bytes;
+    auto *header = reinterpret_cast<ModuleFormat::Header *>(cycle.data());
+    auto *nodes = reinterpret_cast<ModuleFormat::Node *>(cycle.data() + header->nodes_offset);
+    nodes[header->node_count - 1].a = header->node_count - 1;
+    write(cycle);
+    BOOST_CHECK_THROW(Module{path}, std::runtime_error);
+
+    std::filesystem::remove(path);
+}
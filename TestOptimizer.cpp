@@ -0,0 +1,405 @@
+#define BOOST_TEST_MODULE OptimizerTest
+
+#include <boost/test/included/unit_test.hpp>
+#include "Parser.h"
+#include "Inliner.h"
+#include "Bounds.h"
+#include "Loops.h"
+#include "TailCalls.h"
+#include "Memoize.h"
+#include "Effects.h"
+#include "Select.h"
+#include "Compiler.h"
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+static std::string transpile(Parser &parser) {
+    std::ostringstream out;
+    parser.transpile(out);
+    return out.str();
+}
+
+BOOST_AUTO_TEST_CASE(inline_small_function) {
+    Parser parser(std::istringstream(
+            "fn add(a, b) { return a + b; }"
+            "fn main() { return add(1, 2); }"));
+    parser.parse_program();
+
+    Inliner inliner;
+    inliner.run(parser.get_functions());
+
+    BOOST_REQUIRE_EQUAL(inliner.report().size(), 1);
+    BOOST_CHECK(inliner.report()[0].inlined);
+    BOOST_CHECK_EQUAL(parser.get_functions().size(), 1);
+    BOOST_CHECK(transpile(parser).find("add(") == std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(inline_respects_recursion) {
+    Parser parser(std::istringstream(
+            "fn fib(n) { if (n <= 1) return n; return fib(n - 1) + fib(n - 2); }"
+            "fn main() { return fib(9); }"));
+    parser.parse_program();
+
+    Inliner inliner;
+    inliner.run(parser.get_functions());
+
+    for (const auto &decision : inliner.report())
+        BOOST_CHECK(!decision.inlined);
+    BOOST_CHECK_EQUAL(parser.get_functions().size(), 2);
+}
+
+BOOST_AUTO_TEST_CASE(inline_does_not_duplicate_calls) {
+    Parser parser(std::istringstream(
+            "fn sq(x) { return x * x; }"
+            "fn main() { return sq(print(3)); }"));
+    parser.parse_program();
+
+    Inliner inliner;
+    inliner.run(parser.get_functions());
+
+    BOOST_REQUIRE_EQUAL(inliner.report().size(), 1);
+    BOOST_CHECK(!inliner.report()[0].inlined);
+}
+
+BOOST_AUTO_TEST_CASE(inline_keeps_conditional_calls) {
+    Parser parser(std::istringstream(
+            "fn both(a, b) { return a && b; }"
+            "fn main() { print(both(0, print(42))); return 0; }"));
+    parser.parse_program();
+
+    Inliner inliner;
+    inliner.run(parser.get_functions());
+
+    BOOST_REQUIRE_EQUAL(inliner.report().size(), 1);
+    BOOST_CHECK(!inliner.report()[0].inlined);
+    BOOST_CHECK_EQUAL(inliner.report()[0].reason, "argument 2 has a call that might not be evaluated");
+    BOOST_CHECK(transpile(parser).find("both(") != std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(inline_keeps_array_accesses) {
+    Parser parser(std::istringstream(
+            "fn second(a, b) { return b; }"
+            "fn either(c, b) { return c || b; }"
+            "fn main() { let a: [i32; 4]; let i = 7; print(second(a[i], 1)); print(either(1, a[i])); return 0; }"));
+    parser.parse_program();
+
+    Inliner inliner;
+    inliner.run(parser.get_functions());
+
+    BOOST_REQUIRE_EQUAL(inliner.report().size(), 2);
+    BOOST_CHECK_EQUAL(inliner.report()[0].reason, "argument 1 has a checked array access that would be dropped");
+    BOOST_CHECK_EQUAL(inliner.report()[1].reason, "argument 2 has a checked array access that might not be evaluated");
+}
+
+BOOST_AUTO_TEST_CASE(inline_return_in_loop) {
+    Parser parser(std::istringstream(
+            "fn first(n) { while (n > 0) return 1; return 0; }"
+            "fn main() { return first(3); }"));
+    parser.parse_program();
+
+    Inliner inliner;
+    inliner.run(parser.get_functions());
+
+    BOOST_REQUIRE_EQUAL(inliner.report().size(), 1);
+    BOOST_CHECK(!inliner.report()[0].inlined);
+    BOOST_CHECK_EQUAL(inliner.report()[0].reason, "body is not a single return expression");
+}
+
+BOOST_AUTO_TEST_CASE(tail_call_becomes_loop) {
+    Parser parser(std::istringstream(
+            "fn count(n, acc) { if (n == 0) return acc; return count(n - 1, acc + 1); }"
+            "fn main() { return count(10, 0); }"));
+    parser.parse_program();
+
+    TailCallOptimizer optimizer;
+    optimizer.run(parser.get_functions());
+
+    BOOST_REQUIRE_EQUAL(optimizer.report().size(), 1);
+    BOOST_CHECK(!optimizer.report()[0].accumulator);
+    auto output = transpile(parser);
+    BOOST_CHECK(output.find("while (true)") != std::string::npos);
+    BOOST_CHECK(output.find("count((((n))") == std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(tail_call_accumulator) {
+    Parser parser(std::istringstream(
+            "fn sum(n) { if (n == 0) return 0; return n + sum(n - 1); }"
+            "fn fib(n) { if (n <= 1) return n; return fib(n - 1) + fib(n - 2); }"
+            "fn main() { return sum(10) + fib(5); }"));
+    parser.parse_program();
+
+    TailCallOptimizer optimizer;
+    optimizer.run(parser.get_functions());
+
+    BOOST_REQUIRE_EQUAL(optimizer.report().size(), 1);
+    BOOST_CHECK_EQUAL(optimizer.report()[0].function, "sum");
+    BOOST_CHECK(optimizer.report()[0].accumulator == Operator::Add);
+}
+
+BOOST_AUTO_TEST_CASE(tail_call_return_in_loop) {
+    Parser parser(std::istringstream(
+            "fn f(n) { while (n == 0) return 100; return n + f(n - 1); }"
+            "fn g(n) { while (n > 5) return g(n - 1); return n; }"
+            "fn main() { print(f(3)); print(g(9)); return 0; }"));
+    parser.parse_program();
+
+    TailCallOptimizer optimizer;
+    optimizer.run(parser.get_functions());
+
+    BOOST_CHECK(optimizer.report().empty());
+    BOOST_CHECK(transpile(parser).find("arj_acc") == std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(memoize_tree_recursion) {
+    Parser parser(std::istringstream(
+            "fn fib(n) { if (n <= 1) return n; return fib(n - 1) + fib(n - 2); }"
+            "fn main() { return fib(9); }"));
+    parser.parse_program();
+
+    Memoizer memoizer;
+    memoizer.run(parser.get_functions());
+
+    BOOST_REQUIRE_EQUAL(memoizer.report().size(), 1);
+    BOOST_CHECK(memoizer.report()[0].memoized);
+    BOOST_CHECK(transpile(parser).find("arj::memo_cache") != std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(memoize_return_in_loop) {
+    Parser parser(std::istringstream(
+            "fn h(n) { while (n > 1) return h(n - 1) + h(n - 2); return n; }"
+            "fn main() { return h(20); }"));
+    parser.parse_program();
+
+    Memoizer memoizer;
+    memoizer.run(parser.get_functions());
+
+    // The whole body is wrapped, so the return in the loop still returns from it
+    BOOST_REQUIRE_EQUAL(memoizer.report().size(), 1);
+    BOOST_CHECK(memoizer.report()[0].memoized);
+    auto output = transpile(parser);
+    BOOST_CHECK(output.find("h_body(") != std::string::npos);
+    BOOST_CHECK(output.find("while ((((n))>((1))))") != std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(memoize_rejects_impure) {
+    Parser parser(std::istringstream(
+            "memo fn noisy(n) { print(n); return n; }"
+            "fn main() { return noisy(9); }"));
+    parser.parse_program();
+
+    Memoizer memoizer;
+    memoizer.run(parser.get_functions());
+
+    BOOST_REQUIRE_EQUAL(memoizer.report().size(), 1);
+    BOOST_CHECK(!memoizer.report()[0].memoized);
+    BOOST_CHECK(!parser.get_functions()[0]->memoize);
+}
+
+BOOST_AUTO_TEST_CASE(effect_attributes) {
+    Parser parser(std::istringstream(
+            "fn sq(x) { return x * x; }"
+            "memo fn cached(x) { return sq(x); }"
+            "fn user(x) { return cached(x) + 1; }"
+            "fn noisy(x) { return print(user(x)); }"
+            "fn main() { return noisy(2); }"));
+    parser.parse_program();
+
+    EffectAnalysis effects(parser.get_functions());
+    BOOST_CHECK(effects.effect("sq") == Effect::Const);
+    BOOST_CHECK(effects.effect("cached") == Effect::Pure);
+    BOOST_CHECK(effects.effect("user") == Effect::Pure);
+    BOOST_CHECK(effects.effect("noisy") == Effect::Impure);
+    BOOST_CHECK_EQUAL(effects.reason("noisy"), "calls print");
+
+    effects.annotate(parser.get_functions());
+    auto output = transpile(parser);
+    BOOST_CHECK(output.find("[[gnu::const]] static int sq(int x) noexcept") != std::string::npos);
+    BOOST_CHECK(output.find("[[gnu::pure]] static int user(int x) noexcept") != std::string::npos);
+    BOOST_CHECK(output.find("\nstatic int noisy(int x) noexcept") != std::string::npos);
+    BOOST_CHECK(output.find("\nint main() noexcept") != std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(effect_checked_access) {
+    // An unused call to a const function would be dropped, and the abort with it
+    std::ostringstream out, diagnostics;
+    Compiler(CompileOptions{}).compile(
+            "fn h(i: i64) -> i64 { let a: [i64; 4]; return a[i]; }"
+            "fn inside(i: i64) -> i64 { let a: [i64; 4]; if (i >= 0 && i < 4) return a[i]; return 0; }"
+            "fn main() { h(10); print(inside(10)); return 0; }", out, diagnostics);
+    BOOST_CHECK(out.str().find("\nstatic std::int64_t h(std::int64_t i) noexcept") != std::string::npos);
+    BOOST_CHECK(out.str().find("[[gnu::const]] static std::int64_t inside(") != std::string::npos);
+
+    Parser parser(std::istringstream("fn h(i: i64) -> i64 { let a: [i64; 4]; return a[i]; } fn main() { print(h(1)); return 0; }"));
+    parser.parse_program();
+    EffectAnalysis effects(parser.get_functions());
+    BOOST_CHECK(effects.effect("h") == Effect::Impure);
+    BOOST_CHECK_EQUAL(effects.reason("h"), "may access a out of bounds");
+}
+
+BOOST_AUTO_TEST_CASE(select_lowering) {
+    Parser parser(std::istringstream(
+            "fn max(a, b) { return if (a > b) a else b; }"
+            "fn guarded(a, b) { return if (b == 0) 0 else a / b; }"
+            "fn main() { if (max(1, 2) > 1) return guarded(4, 2); else return 1; return 0; }"));
+    parser.parse_program();
+
+    SelectLowering lowering;
+    lowering.run(parser.get_functions());
+
+    auto output = transpile(parser);
+    BOOST_CHECK(output.find("arj::select<int>(static_cast<bool>(((a))>((b))), (a), (b))") != std::string::npos);
+    BOOST_CHECK(output.find("((0)) : ((((a))/((b))))") != std::string::npos);
+    BOOST_CHECK(output.find("else {\nreturn ((1));") != std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(select_guarded_access) {
+    std::ostringstream out, diagnostics;
+    Compiler(CompileOptions{}).compile(
+            "fn get(i: i64) -> i64 { let a: [i64; 4]; return if (i >= 0 && i < 4) a[i] else 0; }"
+            "fn main() { print(get(100000000)); return 0; }", out, diagnostics);
+    BOOST_CHECK(out.str().find("arj::select") == std::string::npos);
+    BOOST_CHECK(out.str().find("? (a[static_cast<std::size_t>((i))])") != std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(loop_optimizations) {
+    Parser parser(std::istringstream(
+            "fn small() { let s = 0; for (let i = 0; i < 3; i = i + 1) s = s + i; return s; }"
+            "fn scaled(n: u32, k: u32) -> u64 {"
+            "    let total: u64 = 0;"
+            "    let i: u32 = 0;"
+            "    while (i < n) { total = total + i * k + (k + 1) * 2; i = i + 1; };"
+            "    return total;"
+            "}"
+            "fn main() { print(small()); print(scaled(10, 3)); return 0; }"));
+    parser.parse_program();
+
+    LoopOptimizer optimizer;
+    optimizer.run(parser.get_functions());
+
+    BOOST_REQUIRE_EQUAL(optimizer.report().size(), 2);
+    BOOST_CHECK(optimizer.report()[0].removed);
+    BOOST_CHECK_EQUAL(optimizer.report()[0].unrolled, 3);
+    BOOST_CHECK_EQUAL(optimizer.report()[1].hoisted, 1);
+    BOOST_CHECK_EQUAL(optimizer.report()[1].reduced, 1);
+    auto output = transpile(parser);
+    BOOST_CHECK(output.find("while") == output.rfind("while"));
+    BOOST_CHECK(output.find("if ((((i))<((n)))) {\n{\nstd::uint32_t arj_inv0 = ((((((k))+((1))))*((2))));\n"
+                            "std::uint32_t arj_iv1 = ((((i))*((k))));") != std::string::npos);
+    BOOST_CHECK(output.find("arj_iv1 = ((((arj_iv1))+((k))))") != std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(bounds_check_elimination) {
+    Parser parser(std::istringstream(
+            "fn sum(n: i64, k: i64) -> i64 {"
+            "    let a: [i64; n];"
+            "    let b: [i64; 8];"
+            "    for (let i: i64 = 0; i < n; i = i + 1) a[i] = i * k;"
+            "    let s: i64 = 0;"
+            "    for (let i: i64 = 0; i < 8; i = i + 1) { b[i] = a[i]; s = s + b[i]; };"
+            "    if (k >= 0 && k < 8) s = s + b[k];"
+            "    return s + b[k] + a[n];"
+            "}"
+            "fn main() { print(sum(10, 2)); return 0; }"));
+    parser.parse_program();
+
+    BoundsCheckElimination elimination;
+    elimination.run(parser.get_functions());
+
+    // a[i] in the second loop could be past n, and neither b[k] nor a[n] after the if is known to be in range
+    BOOST_REQUIRE_EQUAL(elimination.report().size(), 1);
+    BOOST_CHECK_EQUAL(elimination.report()[0].removed, 4);
+    BOOST_CHECK_EQUAL(elimination.report()[0].kept, 3);
+
+    LoopOptimizer optimizer;
+    optimizer.run(parser.get_functions());
+    auto output = transpile(parser);
+    BOOST_CHECK(output.find("#pragma GCC ivdep\nwhile ((((i))<((n))))") != std::string::npos);
+    BOOST_CHECK(output.find("#pragma GCC ivdep\nwhile ((((i))<((8))))") == std::string::npos);
+    BOOST_CHECK(output.find("a[static_cast<std::size_t>((i))] = ((((i))*((k))));") != std::string::npos);
+    BOOST_CHECK(output.find("arj::at(a, (n))") != std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(loop_scopes) {
+    for (auto source : {"fn main() { { let a = 1; }; a = 2; return 0; }",
+                        "fn main() { for (let i = 0; i < 3; i = i + 1) print(i); return i; }",
+                        "fn main() { let a = 0; while (a < 3) let b = a; return 0; }"}) {
+        Parser parser{std::istringstream(source)};
+        BOOST_CHECK_THROW(parser.parse_program(), SyntaxErrorException);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(incremental_cache) {
+    auto directory = std::filesystem::temp_directory_path() / "arjon-compiler-test-cache";
+    std::filesystem::remove_all(directory);
+    const std::string source =
+            "fn add(a, b) { return a + b; }"
+            "fn fib(n) { if (n <= 1) return n; return fib(n - 1) + fib(n - 2); }"
+            "fn main() { print(add(fib(5), 1)); return 0; }";
+
+    std::ostringstream plain, cold, warm, diagnostics;
+    Compiler(CompileOptions{}).compile(source, plain, diagnostics);
+
+    CompileOptions options;
+    options.cache_directory = directory.string();
+    Compiler compiler(options);
+    compiler.compile(source, cold, diagnostics);
+    compiler.compile(source, warm, diagnostics);
+
+    BOOST_CHECK_EQUAL(plain.str(), cold.str());
+    BOOST_CHECK_EQUAL(cold.str(), warm.str());
+
+    // Changing a callee invalidates its callers, but not unrelated functions
+    CompileOptions stats = options;
+    stats.cache_stats = true;
+    std::ostringstream changed, report;
+    auto edited = source;
+    edited.replace(edited.find("a + b"), 5, "a * b");
+    Compiler(stats).compile(edited, changed, report);
+    BOOST_CHECK_EQUAL(report.str(), "cache: 1 hits, 2 misses\n");
+
+    std::filesystem::remove_all(directory);
+}
+
+BOOST_AUTO_TEST_CASE(profile_guided) {
+    auto path = std::filesystem::temp_directory_path() / "arjon-compiler-test.prof";
+    const std::string source =
+            "fn poly(x) { return x * x + x * 3 + x / 2 - 7; }"
+            "fn rare(x) { print(x); return x; }"
+            "fn main() { let t = 0; for (let i = 0; i < 100; i = i + 1) { if (i < 95) t = t + poly(i); "
+            "else t = t - poly(i); }; if (t == 0) rare(t); print(t); return 0; }";
+
+    CompileOptions options;
+    options.instrument = path.string();
+    std::ostringstream instrumented, diagnostics;
+    Compiler(options).compile(source, instrumented, diagnostics);
+    BOOST_CHECK(instrumented.str().find("++arj::profile::calls[") != std::string::npos);
+    BOOST_CHECK(instrumented.str().find("if (arj::profile::branch(") != std::string::npos);
+    BOOST_CHECK(instrumented.str().find("[[gnu::const]]") == std::string::npos);
+
+    // What the instrumented program would have written. The ifs are numbered in pre-order within main.
+    std::ofstream(path) << "arjprof1\ncall main 1\ncall poly 100\ncall rare 0\nbranch main 0 95 5\nbranch main 1 0 1\n";
+    std::ostringstream plain, guided, report;
+    Compiler(CompileOptions{}).compile(source, plain, diagnostics);
+    options = {};
+    options.profile_use = path.string();
+    options.profile_report = true;
+    Compiler(options).compile(source, guided, report);
+    BOOST_CHECK_EQUAL(report.str(), "profile: 1 hot and 1 cold functions, 1 likely and 0 unlikely ifs\n");
+    BOOST_CHECK(guided.str().find("[[likely]]") != std::string::npos);
+    BOOST_CHECK(guided.str().find("else [[unlikely]]") != std::string::npos);
+    BOOST_CHECK(guided.str().find("[[gnu::cold]]") != std::string::npos);
+    // Too large to inline at two call sites, unless it's hot
+    BOOST_CHECK(plain.str().find("poly(") != std::string::npos);
+    BOOST_CHECK(guided.str().find("poly(") == std::string::npos);
+
+    // An if that isn't in the source any more
+    std::ofstream(path) << "arjprof1\nbranch main 2 10 10\n";
+    std::ostringstream stale;
+    Compiler(options).compile(source, guided, stale);
+    BOOST_CHECK(stale.str().find("main has changed") != std::string::npos);
+
+    std::ofstream(path) << "arjprof1\ncall main\n";
+    BOOST_CHECK_THROW(Compiler(options).compile(source, guided, stale), std::runtime_error);
+    std::filesystem::remove(path);
+}
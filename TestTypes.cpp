@@ -0,0 +1,61 @@
+#define BOOST_TEST_MODULE TypesTest
+
+#include <boost/test/included/unit_test.hpp>
+#include "Parser.h"
+#include "Types.h"
+#include <sstream>
+
+static std::string transpile(const std::string &source) {
+    Parser parser(std::istringstream{source});
+    parser.parse_program();
+    std::ostringstream out;
+    parser.transpile(out);
+    return out.str();
+}
+
+static bool rejects(const std::string &source) {
+    try {
+        transpile(source);
+    } catch (const SyntaxErrorException &) {
+        return true;
+    }
+    return false;
+}
+
+BOOST_AUTO_TEST_CASE(conversions) {
+    BOOST_CHECK(Types::converts(IntegerType::I8, IntegerType::I64));
+    BOOST_CHECK(Types::converts(IntegerType::U32, IntegerType::I64));
+    BOOST_CHECK(Types::converts(IntegerType::Int, IntegerType::I32) && Types::converts(IntegerType::I32, IntegerType::Int));
+    BOOST_CHECK(!Types::converts(IntegerType::U32, IntegerType::I32));
+    BOOST_CHECK(!Types::converts(IntegerType::I8, IntegerType::U64));
+    BOOST_CHECK(!Types::common(IntegerType::U64, IntegerType::I64));
+    BOOST_CHECK(Types::common(IntegerType::U8, IntegerType::I16) == IntegerType::I16);
+}
+
+BOOST_AUTO_TEST_CASE(exact_width_emission) {
+    auto output = transpile("fn scale(x: i32, k: u16) -> i64 { let y: i64 = x; return y * k; }"
+                            "fn main() { let big = 5000000000; print(big); print(scale(7, 2)); return 0; }");
+    BOOST_CHECK(output.find("std::int64_t scale(std::int32_t x, std::uint16_t k) noexcept") != std::string::npos);
+    BOOST_CHECK(output.find("std::int64_t y = ((x));") != std::string::npos);
+    // Unannotated declarations take the type of their value
+    BOOST_CHECK(output.find("std::int64_t big = ((5000000000));") != std::string::npos);
+    BOOST_CHECK(rejects("fn f(x: i32) -> i32 { return x; } fn main() { let big = 5000000000; return f(big); }"));
+
+    // Untyped programs are emitted like before
+    output = transpile("fn add(a, b) { let c = a + b; return c; } fn main() { return add(1, 2); }");
+    BOOST_CHECK(output.find("int add(int a, int b) noexcept") != std::string::npos);
+    BOOST_CHECK(output.find("int c = (") != std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(type_errors) {
+    BOOST_CHECK(rejects("fn main() { let a: i8 = 128; return 0; }"));
+    BOOST_CHECK(!rejects("fn main() { let a: i8 = 127; let b: u8 = 255; return 0; }"));
+    BOOST_CHECK(rejects("fn main() { let a: u8 = 1 - 2; return 0; }"));
+    BOOST_CHECK(rejects("fn main() { let a: i64 = 100000 * 100000; return 0; }"));
+    BOOST_CHECK(rejects("fn main() { let a: u32 = 1; let b: i32 = 2; print(a + b); return 0; }"));
+    BOOST_CHECK(rejects("fn f(a: i16) -> i16 { return a; } fn main() { let x: i32 = 1; return f(x); }"));
+    BOOST_CHECK(rejects("fn f() -> i64 { return 1; } fn main() { return f(); }"));
+    BOOST_CHECK(rejects("fn main() { let a: i32 = if (1 < 2) 70000 else 300000000000; return 0; }"));
+    BOOST_CHECK(rejects("fn main() { let a: f64 = 1; return 0; }"));
+    BOOST_CHECK(!rejects("fn f(a: u32) -> i64 { return a; } fn main() { let x: u8 = 7; print(f(x)); return 0; }"));
+}
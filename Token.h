@@ -25,16 +25,17 @@ enum class Punctuation {
     Semicolon,      // ';'
     Comma,          // ','
 
-    /* Might implement in the future
-    // End of statement
-    NewLine,        // '\n'
-
+    // Type annotations
     Colon,          // ':'
 
     // Brackets
     OpenBracket,    // '['
     CloseBracket,   // ']'
 
+    /* Might implement in the future
+    // End of statement
+    NewLine,        // '\n'
+
     Dot,            // '.'
     DoubleColon,    // '::'
     Ellipsis,       // '...'
@@ -73,9 +74,11 @@ enum class Operator {
     LogicalOr,      // '||'
     LogicalNot,     // '!'
 
+    // Return type
+    RightArrow,     // '->'
+
     /* Might implement in the future
     // Other operators
-    RightArrow,     // '->'
     LeftArrow,      // '<-'
 
     // Bitwise operators
@@ -100,6 +103,10 @@ enum class Keyword {
     Else,
     Fn,
     Let,
+    Memo,
+    Import,
+    While,
+    For,
 };
 
 using Token = std::variant<
@@ -0,0 +1,369 @@
+#include "Types.h"
+#include "Lexer.h"
+#include <algorithm>
+#include <array>
+#include <string>
+
+namespace {
+    struct TypeInfo {
+        IntegerType type;
+        std::string_view name;
+        std::string_view cpp_name;
+        bool is_signed;
+        unsigned bits;
+    };
+
+    constexpr std::array<TypeInfo, 9> type_info{{
+        {IntegerType::Int, "int", "int", true, 32},
+        {IntegerType::I8, "i8", "std::int8_t", true, 8},
+        {IntegerType::I16, "i16", "std::int16_t", true, 16},
+        {IntegerType::I32, "i32", "std::int32_t", true, 32},
+        {IntegerType::I64, "i64", "std::int64_t", true, 64},
+        {IntegerType::U8, "u8", "std::uint8_t", false, 8},
+        {IntegerType::U16, "u16", "std::uint16_t", false, 16},
+        {IntegerType::U32, "u32", "std::uint32_t", false, 32},
+        {IntegerType::U64, "u64", "std::uint64_t", false, 64},
+    }};
+
+    const TypeInfo &info(IntegerType type) {
+        return type_info[static_cast<std::size_t>(type)];
+    }
+
+    using Types::Wide;
+
+    Wide min_value(IntegerType type) {
+        return info(type).is_signed ? -(Wide(1) << (info(type).bits - 1)) : 0;
+    }
+
+    Wide max_value(IntegerType type) {
+        return (Wide(1) << (info(type).bits - info(type).is_signed)) - 1;
+    }
+
+    std::string to_string(Wide value) {
+        if(value < 0)
+            return "-" + to_string(-value);
+        std::string digits;
+        do {
+            digits.insert(digits.begin(), static_cast<char>('0' + static_cast<int>(value % 10)));
+            value /= 10;
+        } while(value != 0);
+        return digits;
+    }
+
+    // Every value a constant expression can have, and the type C++ evaluates it in: int, long or unsigned long long
+    struct Constant {
+        Wide low, high;
+        IntegerType type;
+    };
+
+    IntegerType literal_type(IntegerLiteral value) {
+        if(value <= static_cast<IntegerLiteral>(max_value(IntegerType::Int)))
+            return IntegerType::Int;
+        if(value <= static_cast<IntegerLiteral>(max_value(IntegerType::I64)))
+            return IntegerType::I64;
+        return IntegerType::U64;
+    }
+
+    // The usual arithmetic conversions for the three types a constant can have
+    IntegerType promote(IntegerType a, IntegerType b) {
+        if(a == IntegerType::U64 || b == IntegerType::U64)
+            return IntegerType::U64;
+        if(a == IntegerType::I64 || b == IntegerType::I64)
+            return IntegerType::I64;
+        return IntegerType::Int;
+    }
+
+    using Types::is_arithmetic;
+
+    bool is_logical(Operator op) {
+        return op == Operator::LogicalAnd || op == Operator::LogicalOr || op == Operator::LogicalNot;
+    }
+
+    [[noreturn]] void type_error(const std::string &message) {
+        throw SyntaxErrorException(message);
+    }
+
+    // Evaluates a constant expression as intervals, so conditionals don't need a constant condition.
+    // Conditionals get the type C++ gives them, the caller narrows it to where the value is used.
+    Constant evaluate(AST::Node &node) {
+        if(auto *literal = dynamic_cast<AST::IntegerLiteralNode *>(&node))
+            return {Wide(literal->value), Wide(literal->value), literal_type(literal->value)};
+        if(auto *conditional = dynamic_cast<AST::ConditionalNode *>(&node)) {
+            auto then = evaluate(*conditional->then), otherwise = evaluate(*conditional->otherwise);
+            conditional->type = promote(then.type, otherwise.type);
+            return {std::min(then.low, otherwise.low), std::max(then.high, otherwise.high), conditional->type};
+        }
+        auto *binary = dynamic_cast<AST::BinaryOpNode *>(&node);
+        if(!binary)
+            throw std::logic_error("Not a constant expression");
+
+        auto left = evaluate(*binary->left), right = evaluate(*binary->right);
+        if(!is_arithmetic(binary->op))
+            return {0, 1, IntegerType::Int};
+
+        Constant result{0, 0, promote(left.type, right.type)};
+        auto hull = [&](std::initializer_list<Wide> values) {
+            result.low = std::min(values);
+            result.high = std::max(values);
+        };
+        switch(binary->op) {
+            case Operator::Add:
+                hull({left.low + right.low, left.high + right.high});
+                break;
+            case Operator::Subtract:
+                hull({left.low - right.high, left.high - right.low});
+                break;
+            case Operator::Multiply:
+                hull({left.low * right.low, left.low * right.high, left.high * right.low, left.high * right.high});
+                break;
+            case Operator::Divide:
+            case Operator::Modulus: {
+                if(right.low == 0 && right.high == 0)
+                    type_error("Division by zero in a constant expression");
+                const auto magnitude = std::max(-left.low, left.high);
+                if(binary->op == Operator::Modulus) {
+                    const auto limit = std::min(magnitude, std::max(-right.low, right.high) - 1);
+                    hull({left.low < 0 ? -limit : 0, left.high > 0 ? limit : 0});
+                } else if(right.low <= 0 && right.high >= 0) {
+                    hull({-magnitude, magnitude});
+                } else {
+                    hull({left.low / right.low, left.low / right.high, left.high / right.low, left.high / right.high});
+                }
+                break;
+            }
+            default:
+                break;
+        }
+        if(result.low < min_value(result.type) || result.high > max_value(result.type))
+            type_error("Constant expression overflows " + std::string(info(result.type).name));
+        return result;
+    }
+
+    // Gives the conditionals a constant flows through the type it ends up as
+    void narrow(AST::Node &node, IntegerType type) {
+        if(auto *conditional = dynamic_cast<AST::ConditionalNode *>(&node)) {
+            conditional->type = type;
+            narrow(*conditional->then, type);
+            narrow(*conditional->otherwise, type);
+        } else if(auto *binary = dynamic_cast<AST::BinaryOpNode *>(&node); binary && is_arithmetic(binary->op)) {
+            narrow(*binary->left, type);
+            narrow(*binary->right, type);
+        }
+    }
+}
+
+std::optional<IntegerType> Types::parse(std::string_view name) {
+    for(const auto &type : type_info) {
+        if(type.type != IntegerType::Int && type.name == name)
+            return type.type;
+    }
+    return std::nullopt;
+}
+
+std::string_view Types::name(IntegerType type) {
+    return info(type).name;
+}
+
+std::string_view Types::cpp_name(IntegerType type) {
+    return info(type).cpp_name;
+}
+
+std::size_t Types::size(IntegerType type) {
+    return info(type).bits / 8;
+}
+
+bool Types::converts(IntegerType from, IntegerType to) {
+    return min_value(from) >= min_value(to) && max_value(from) <= max_value(to);
+}
+
+std::optional<IntegerType> Types::common(IntegerType a, IntegerType b) {
+    if(converts(a, b))
+        return b;
+    if(converts(b, a))
+        return a;
+    return std::nullopt;
+}
+
+bool Types::is_arithmetic(Operator op) {
+    return op == Operator::Add || op == Operator::Subtract || op == Operator::Multiply
+           || op == Operator::Divide || op == Operator::Modulus;
+}
+
+Types::Wide Types::min(IntegerType type) {
+    return min_value(type);
+}
+
+Types::Wide Types::max(IntegerType type) {
+    return max_value(type);
+}
+
+IntegerType Types::literal(IntegerLiteral value) {
+    return literal_type(value);
+}
+
+IntegerType Types::arithmetic(IntegerType a, IntegerType b) {
+    auto promoted = [](IntegerType type) { return info(type).bits < 32 ? IntegerType::Int : type; };
+    a = promoted(a);
+    b = promoted(b);
+    if(info(a).bits != info(b).bits)
+        return info(a).bits > info(b).bits ? a : b;
+    if(info(a).is_signed != info(b).is_signed)
+        return info(a).is_signed ? b : a;
+    // Int and i32 are the same type
+    return a;
+}
+
+void TypeChecker::check(AST::FunctionNode &checked) {
+    function = &checked;
+    variables.clear();
+    arrays.clear();
+    for(std::size_t i = 0; i < checked.parameters.size(); ++i)
+        variables[checked.parameters[i]] = checked.parameter_types[i];
+    for(auto &statement : checked.statements)
+        check_statement(*statement);
+}
+
+void TypeChecker::check_statement(AST::Node &node) {
+    if(auto *declaration = dynamic_cast<AST::DeclarationNode *>(&node)) {
+        auto type = infer(*declaration->expression);
+        if(declaration->type == IntegerType::Int) {
+            // Unannotated, a constant keeps the type C++ would give it
+            declaration->type = type ? *type : evaluate(*declaration->expression).type;
+        }
+        convert(*declaration->expression, type, declaration->type, "the declaration of " + declaration->name);
+        variables[declaration->name] = declaration->type;
+        arrays.erase(declaration->name);
+    } else if(auto *array = dynamic_cast<AST::ArrayDeclarationNode *>(&node)) {
+        if(auto type = infer(*array->size); !type)
+            convert(*array->size, type, IntegerType::U64, "the size of " + array->name);
+        variables[array->name] = array->element_type;
+        arrays.insert(array->name);
+    } else if(auto *assignment = dynamic_cast<AST::AssignmentNode *>(&node)) {
+        if(auto *element = dynamic_cast<AST::IndexNode *>(assignment->element.get()))
+            check_index(*element);
+        else if(arrays.contains(assignment->name))
+            type_error(assignment->name + " is an array, only its elements can be assigned");
+        convert(*assignment->expression, infer(*assignment->expression), variables.at(assignment->name),
+                "the assignment to " + assignment->name);
+    } else if(auto *ret = dynamic_cast<AST::ReturnNode *>(&node)) {
+        convert(*ret->expression, infer(*ret->expression), function->return_type,
+                "the return value of " + function->name);
+    } else if(auto *branch = dynamic_cast<AST::IfNode *>(&node)) {
+        if(!infer(*branch->expression))
+            evaluate(*branch->expression);
+        check_statement(*branch->statement);
+        if(branch->elseStatement)
+            check_statement(*branch->elseStatement);
+    } else if(auto *block = dynamic_cast<AST::BlockNode *>(&node)) {
+        auto outer = variables;
+        auto outer_arrays = arrays;
+        for(auto &statement : block->statements)
+            check_statement(*statement);
+        variables = std::move(outer);
+        arrays = std::move(outer_arrays);
+    } else if(auto *loop = dynamic_cast<AST::WhileNode *>(&node)) {
+        if(loop->condition && !infer(*loop->condition))
+            evaluate(*loop->condition);
+        check_statement(*loop->body);
+    } else if(!dynamic_cast<AST::ContinueNode *>(&node)) {
+        if(!infer(node))
+            evaluate(node);
+    }
+}
+
+std::optional<IntegerType> TypeChecker::infer(AST::Node &node) {
+    if(dynamic_cast<AST::IntegerLiteralNode *>(&node))
+        return std::nullopt;
+    if(auto *id = dynamic_cast<AST::IdentifierNode *>(&node)) {
+        if(arrays.contains(id->identifier))
+            type_error(id->identifier + " is an array, only its elements can be used");
+        return variables.at(id->identifier);
+    }
+    if(auto *element = dynamic_cast<AST::IndexNode *>(&node)) {
+        check_index(*element);
+        return variables.at(element->array);
+    }
+    if(auto *binary = dynamic_cast<AST::BinaryOpNode *>(&node)) {
+        if(is_logical(binary->op)) {
+            auto left = infer(*binary->left), right = infer(*binary->right);
+            if(!left && !right)
+                return std::nullopt;
+            if(!left)
+                evaluate(*binary->left);
+            if(!right)
+                evaluate(*binary->right);
+            return IntegerType::Int;
+        }
+        auto type = unify(*binary->left, *binary->right);
+        if(type && !is_arithmetic(binary->op))
+            return IntegerType::Int;
+        return type;
+    }
+    if(auto *conditional = dynamic_cast<AST::ConditionalNode *>(&node)) {
+        if(!infer(*conditional->condition))
+            evaluate(*conditional->condition);
+        auto type = unify(*conditional->then, *conditional->otherwise);
+        if(type)
+            conditional->type = *type;
+        return type;
+    }
+    if(auto *call = dynamic_cast<AST::FunctionCall *>(&node)) {
+        // print is a template in the prelude, so it takes any type
+        auto signature = call->identifier == "print" ? std::nullopt : lookup(call->identifier);
+        for(std::size_t i = 0; i < call->arguments.size(); ++i) {
+            auto &argument = *call->arguments[i];
+            auto type = infer(argument);
+            if(signature && i < signature->parameters.size())
+                convert(argument, type, signature->parameters[i],
+                        "argument " + std::to_string(i + 1) + " of " + call->identifier);
+            else if(!type)
+                evaluate(argument);
+        }
+        // Unknown to the lookup when checking a tree that didn't come from the parser
+        return signature ? signature->result : IntegerType::Int;
+    }
+    throw std::logic_error("Unexpected node in an expression");
+}
+
+void TypeChecker::check_index(AST::IndexNode &element) {
+    if(!arrays.contains(element.array))
+        type_error(element.array + " is not an array");
+    // Any type works as an index, constants are checked to not be negative
+    if(auto type = infer(*element.index); !type)
+        convert(*element.index, type, IntegerType::U64, "the index into " + element.array);
+}
+
+void TypeChecker::convert(AST::Node &node, std::optional<IntegerType> from, IntegerType type, std::string_view what) {
+    if(!from) {
+        auto value = evaluate(node);
+        if(value.low < min_value(type) || value.high > max_value(type)) {
+            auto values = value.low == value.high ? to_string(value.low)
+                                                  : to_string(value.low) + " to " + to_string(value.high);
+            type_error(values + " doesn't fit in " + std::string(Types::name(type)) + " in " + std::string(what));
+        }
+        narrow(node, type);
+    } else if(!Types::converts(*from, type)) {
+        type_error("Can't convert " + std::string(Types::name(*from)) + " to " + std::string(Types::name(type))
+                   + " in " + std::string(what) + " without losing values");
+    }
+}
+
+std::optional<IntegerType> TypeChecker::unify(AST::Node &left, AST::Node &right) {
+    auto left_type = infer(left), right_type = infer(right);
+    if(!left_type && !right_type)
+        return std::nullopt;
+    if(!left_type) {
+        convert(left, left_type, *right_type, "an operand");
+        return right_type;
+    }
+    if(!right_type) {
+        convert(right, right_type, *left_type, "an operand");
+        return left_type;
+    }
+    auto type = Types::common(*left_type, *right_type);
+    if(!type) {
+        type_error("Can't mix " + std::string(Types::name(*left_type)) + " and "
+                   + std::string(Types::name(*right_type)) + " without losing values");
+    }
+    return type;
+}
@@ -0,0 +1,85 @@
+#pragma once
+#ifndef COMPILER_TYPES_H
+#define COMPILER_TYPES_H
+
+#include "ASTNode.h"
+#include <functional>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace Types {
+    // Wide enough for the product of any two 64 bit values
+    using Wide = __int128;
+
+    // i8 ... u64, nullopt for anything else
+    std::optional<IntegerType> parse(std::string_view name);
+
+    // As written in the source, Int is "int"
+    std::string_view name(IntegerType);
+
+    // The exact width type, Int stays a plain int
+    std::string_view cpp_name(IntegerType);
+
+    // In bytes
+    std::size_t size(IntegerType);
+
+    // Every value of from is a value of to. Int is the same as i32 here.
+    bool converts(IntegerType from, IntegerType to);
+
+    // The type both operands convert to, if there is one
+    std::optional<IntegerType> common(IntegerType, IntegerType);
+
+    // + - * / %, the operators whose result has the type of their operands
+    bool is_arithmetic(Operator);
+
+    Wide min(IntegerType);
+
+    Wide max(IntegerType);
+
+    // The type C++ gives an integer literal: int, long or unsigned long long
+    IntegerType literal(IntegerLiteral);
+
+    // The type C++ evaluates +, -, * and / in, after promoting both operands. Narrower types than int become Int.
+    IntegerType arithmetic(IntegerType, IntegerType);
+}
+
+// Checks that every value fits the type it ends up in, so nothing is truncated silently.
+// A conversion has to be lossless, so u32 mixes with i64 but not with i32. Literals take the type they are used
+// as, and constant expressions are evaluated to check that they fit.
+// Records the types the transpiler needs: unannotated declarations get the type of their expression and every
+// conditional gets the type of its arms. Throws SyntaxErrorException on a type error.
+class TypeChecker {
+public:
+    using SignatureLookup = std::function<std::optional<Signature>(const Identifier &function)>;
+
+private:
+    SignatureLookup lookup;
+    // Arrays map to the type of their elements
+    std::unordered_map<Identifier, IntegerType> variables;
+    std::unordered_set<Identifier> arrays;
+    const AST::FunctionNode *function = nullptr;
+
+public:
+    explicit TypeChecker(SignatureLookup lookup) : lookup(std::move(lookup)) {}
+
+    void check(AST::FunctionNode &);
+
+private:
+    void check_statement(AST::Node &);
+
+    // The index of an element access, checks that the array is one
+    void check_index(AST::IndexNode &);
+
+    // nullopt for constant expressions, those get their type from where they're used
+    std::optional<IntegerType> infer(AST::Node &);
+
+    // Checks that the expression, inferred as from, fits in type
+    void convert(AST::Node &, std::optional<IntegerType> from, IntegerType type, std::string_view what);
+
+    // Both operands in one type, nullopt if both are constant
+    std::optional<IntegerType> unify(AST::Node &left, AST::Node &right);
+};
+
+#endif //COMPILER_TYPES_H
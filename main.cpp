@@ -1,18 +1,150 @@
 #include <iostream>
-#include "Parser.h"
+#include "Compiler.h"
+#include "Module.h"
+#include "Build.h"
+#include "Daemon.h"
+#include "Stats.h"
 
+#include <filesystem>
 #include <fstream>
+#include <optional>
+#include <sstream>
+#include <string_view>
+#include <vector>
 
+namespace {
+    // Prints the statistics on the way out of main, however the compile ended
+    struct StatsReport {
+        bool table = false, json = false;
 
-int main() {
+        ~StatsReport() {
+            if (table)
+                Stats::print(std::cerr, false);
+            if (json)
+                Stats::print(std::cerr, true);
+        }
+    };
+}
+
+int main(int argc, char *argv[]) {
+    std::string path = "../test.txt";
+    std::vector<std::string> inputs;
+    CompileOptions options;
+    std::optional<ProgramBuilder::Options> build;
+    std::optional<BatchCompiler::Options> batch;
+    std::filesystem::path daemon_socket, client_socket;
+    bool stop_daemon = false;
+    // Passed on to the daemon as they are
+    std::vector<std::string> client_arguments;
+    std::filesystem::path interface_directory;
+    std::size_t jobs = 0;
+    bool time_report = false, stats = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (options.parse(arg)) {
+            client_arguments.emplace_back(arg);
+            continue;
+        }
+        if (arg.starts_with("--build="))
+            build.emplace().output_directory = arg.substr(std::string_view("--build=").size());
+        else if (arg.starts_with("--output-dir="))
+            batch.emplace().output_directory = arg.substr(std::string_view("--output-dir=").size());
+        else if (arg.starts_with("--interfaces="))
+            interface_directory = arg.substr(std::string_view("--interfaces=").size());
+        else if (arg.starts_with("--daemon="))
+            daemon_socket = arg.substr(std::string_view("--daemon=").size());
+        else if (arg.starts_with("--connect="))
+            client_socket = arg.substr(std::string_view("--connect=").size());
+        else if (arg == "--stop")
+            stop_daemon = true;
+        else if (arg == "--time-report")
+            time_report = true;
+        else if (arg == "--stats")
+            stats = true;
+        else if (arg.starts_with("--jobs="))
+            jobs = std::stoul(std::string(arg.substr(std::string_view("--jobs=").size())));
+        else
+            inputs.emplace_back(path = arg);
+    }
+
+    if (!daemon_socket.empty()) {
+        try {
+            CompileServer server({daemon_socket, jobs});
+            server.run(std::cerr);
+        } catch (const std::runtime_error &e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    if (!client_socket.empty()) {
+        try {
+            if (stop_daemon) {
+                Daemon::stop(client_socket);
+                return 0;
+            }
+            // Read here, the daemon may not run in the same directory
+            std::ifstream src(path);
+            if (!src) {
+                std::cerr << path << ": cannot read file" << std::endl;
+                return 1;
+            }
+            std::stringstream source;
+            source << src.rdbuf();
+            client_arguments.push_back(path);
+            auto response = Daemon::send(client_socket, {std::move(client_arguments), std::move(source).str()});
+            std::cout << response.output;
+            std::cerr << response.diagnostics;
+            return response.exit_code;
+        } catch (const std::runtime_error &e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    Stats::enabled = time_report || stats;
+    StatsReport report{time_report, stats};
+
+    if (batch) {
+        std::vector<std::filesystem::path> paths;
+        bool expanded = BatchCompiler::expand(inputs, paths, std::cerr);
+        batch->jobs = jobs;
+        auto result = BatchCompiler(std::move(options), std::move(*batch)).compile(paths, std::cerr);
+        return expanded && result.failed == 0 ? 0 : 1;
+    }
 
-    std::ifstream src("../test.txt");
-    Parser parser(std::move(src));
+    if (build) {
+        build->interface_directory = std::move(interface_directory);
+        build->jobs = jobs;
+        std::vector<std::filesystem::path> paths(inputs.begin(), inputs.end());
+        return ProgramBuilder(std::move(options), std::move(*build)).build(paths, std::cerr) ? 0 : 1;
+    }
+
+    std::ostringstream out;
     try {
-        parser.parse_program();
+        if (options.from_module) {
+            Module module(path);
+            Compiler(std::move(options)).compile(module, out, std::cerr);
+        } else {
+            std::ifstream src(path);
+            std::stringstream source;
+            source << src.rdbuf();
+
+            if (!options.emit_module.empty()) {
+                std::ofstream module(options.emit_module, std::ios::binary);
+                Compiler::emit_module(source.str(), module);
+                return 0;
+            }
+            Compiler compiler(std::move(options));
+            compiler.compile(source.str(), out, std::cerr);
+        }
     } catch (const SyntaxErrorException& e) {
         std::cout << e.what() << ". At line " << e.getLine() << ", pos. " << e.getPosition() << '.' << std::endl;
         return 0;
+    } catch (const std::runtime_error& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
     }
-    parser.transpile(std::cout);
+    std::cout << out.str();
 }